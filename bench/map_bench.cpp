@@ -0,0 +1,373 @@
+// 块大小基准：把指令流折算成各索引文件上的插入/删除/查找，
+// 分别用 4/16/64/256 KB 的块重放，报告每个索引文件的耗时、文件大小和最快的块大小
+//
+// 用法: map_bench [指令文件...]
+// 指令文件与 ./code 的标准输入格式相同；不给文件时用内置的随机指令流
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <chrono>
+#include <random>
+#include <iomanip>
+#include <filesystem>
+#include <unistd.h>
+#include "../include/map.h"
+#include "../include/book.h"
+
+namespace {
+
+enum IndexId { ISBN_FILE = 0, ID_FILE, NAME_FILE, AUTHOR_FILE, KEYWORD_FILE, FINANCE_FILE, INDEX_COUNT };
+const char* const INDEX_NAMES[INDEX_COUNT] = {"isbn", "id", "name", "author", "keyword", "finance"};
+
+enum OpKind { INSERT, REMOVE, FIND };
+
+struct Op {
+    IndexId index;
+    OpKind kind;
+    std::string key;        // 字符串键（编号表为 ISBN）；财务表为交易编号
+    int id;                 // 图书编号：编号表的键，二级索引的值
+    BookData book;          // ISBN 表的值
+    FinanceRecord record;   // 财务表的值
+};
+
+struct BookState {
+    int id = 0;
+    std::string name, author, keywords;
+    double price = 0;
+    long long stock = 0;
+};
+
+std::vector<std::string> splitKeywords(const std::string& keywords) {
+    std::vector<std::string> result;
+    std::stringstream ss(keywords);
+    std::string keyword;
+    while (std::getline(ss, keyword, '|')) {
+        if (!keyword.empty()) result.push_back(keyword);
+    }
+    return result;
+}
+
+std::string unquote(const std::string& value) {
+    if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+        return value.substr(1, value.size() - 2);
+    }
+    return value;
+}
+
+// 按书店的语义重放指令，记下每条指令在各索引文件上产生的操作
+class Recorder {
+private:
+    std::map<std::string, BookState> books;
+    std::string selected;
+    int financeCount = 0;
+    int bookCount = 0;
+
+public:
+    std::vector<Op> ops;
+
+    void record(const std::string& line) {
+        std::istringstream in(line);
+        std::vector<std::string> tokens;
+        std::string token;
+        while (in >> token) tokens.push_back(token);
+        if (tokens.empty()) return;
+
+        const std::string& cmd = tokens[0];
+        if (cmd == "select" && tokens.size() == 2) {
+            select(tokens[1]);
+        } else if (cmd == "modify" && !selected.empty()) {
+            modify(std::vector<std::string>(tokens.begin() + 1, tokens.end()));
+        } else if (cmd == "import" && tokens.size() == 3 && !selected.empty()) {
+            BookState& book = books[selected];
+            bookRemoved(selected, book);
+            book.stock += std::stoll(tokens[1]);
+            bookAdded(selected, book, false);
+            financeAdded(0, std::stod(tokens[2]));
+        } else if (cmd == "buy" && tokens.size() == 3) {
+            ops.push_back({ISBN_FILE, FIND, tokens[1], 0, BookData(), FinanceRecord()});
+            auto it = books.find(tokens[1]);
+            const long long quantity = std::stoll(tokens[2]);
+            if (it == books.end() || it->second.stock < quantity) return;
+            bookRemoved(it->first, it->second);
+            it->second.stock -= quantity;
+            bookAdded(it->first, it->second, false);
+            financeAdded(it->second.price * quantity, 0);
+        } else if (cmd == "show" && tokens.size() == 2) {
+            show(tokens[1]);
+        }
+    }
+
+private:
+    void select(const std::string& isbn) {
+        ops.push_back({ISBN_FILE, FIND, isbn, 0, BookData(), FinanceRecord()});
+        if (!books.count(isbn)) {
+            books[isbn] = BookState();
+            books[isbn].id = ++bookCount;
+            bookAdded(isbn, books[isbn], true);
+        }
+        selected = isbn;
+    }
+
+    void modify(const std::vector<std::string>& params) {
+        BookState book = books[selected];
+        std::string isbn = selected;
+        for (const std::string& param : params) {
+            const size_t eq = param.find('=');
+            if (eq == std::string::npos) return;
+            const std::string type = param.substr(0, eq);
+            const std::string value = unquote(param.substr(eq + 1));
+            if (type == "-ISBN") isbn = value;
+            else if (type == "-name") book.name = value;
+            else if (type == "-author") book.author = value;
+            else if (type == "-keyword") book.keywords = value;
+            else if (type == "-price") book.price = std::stod(value);
+            else return;
+        }
+        if (isbn != selected && books.count(isbn)) return;
+
+        // 二级索引存编号，改 ISBN 只动 ISBN 表和编号表，其余索引只改变了的字段
+        const BookState old = books[selected];
+        bookRemoved(selected, old);
+        books.erase(selected);
+        books[isbn] = book;
+        bookAdded(isbn, book, false);
+        if (isbn != selected) {
+            ops.push_back({ID_FILE, REMOVE, selected, book.id, BookData(), FinanceRecord()});
+            ops.push_back({ID_FILE, INSERT, isbn, book.id, BookData(), FinanceRecord()});
+        }
+        if (old.name != book.name) {
+            if (!old.name.empty()) ops.push_back({NAME_FILE, REMOVE, old.name, book.id, BookData(), FinanceRecord()});
+            if (!book.name.empty()) ops.push_back({NAME_FILE, INSERT, book.name, book.id, BookData(), FinanceRecord()});
+        }
+        if (old.author != book.author) {
+            if (!old.author.empty()) ops.push_back({AUTHOR_FILE, REMOVE, old.author, book.id, BookData(), FinanceRecord()});
+            if (!book.author.empty()) ops.push_back({AUTHOR_FILE, INSERT, book.author, book.id, BookData(), FinanceRecord()});
+        }
+        if (old.keywords != book.keywords) {
+            for (const std::string& keyword : splitKeywords(old.keywords)) {
+                ops.push_back({KEYWORD_FILE, REMOVE, keyword, book.id, BookData(), FinanceRecord()});
+            }
+            for (const std::string& keyword : splitKeywords(book.keywords)) {
+                ops.push_back({KEYWORD_FILE, INSERT, keyword, book.id, BookData(), FinanceRecord()});
+            }
+        }
+        selected = isbn;
+    }
+
+    void show(const std::string& param) {
+        const size_t eq = param.find('=');
+        if (eq == std::string::npos) return;
+        const std::string type = param.substr(0, eq);
+        const std::string value = unquote(param.substr(eq + 1));
+
+        IndexId index;
+        if (type == "-ISBN") {
+            ops.push_back({ISBN_FILE, FIND, value, 0, BookData(), FinanceRecord()});
+            return;
+        } else if (type == "-name") {
+            index = NAME_FILE;
+        } else if (type == "-author") {
+            index = AUTHOR_FILE;
+        } else if (type == "-keyword") {
+            index = KEYWORD_FILE;
+        } else {
+            return;
+        }
+        ops.push_back({index, FIND, value, 0, BookData(), FinanceRecord()});
+
+        // 命中的书经编号表查到 ISBN，再回 ISBN 表取完整记录
+        for (const auto& [isbn, book] : books) {
+            bool hit = false;
+            if (index == NAME_FILE) hit = book.name == value;
+            else if (index == AUTHOR_FILE) hit = book.author == value;
+            else for (const std::string& keyword : splitKeywords(book.keywords)) hit |= keyword == value;
+            if (!hit) continue;
+            ops.push_back({ID_FILE, FIND, isbn, book.id, BookData(), FinanceRecord()});
+            ops.push_back({ISBN_FILE, FIND, isbn, 0, BookData(), FinanceRecord()});
+        }
+    }
+
+    void financeAdded(double income, double expense) {
+        ops.push_back({FINANCE_FILE, INSERT, std::to_string(++financeCount), 0, BookData(),
+                       FinanceRecord(income, expense)});
+    }
+
+    BookData dataOf(const std::string& isbn, const BookState& book) const {
+        return BookData(isbn, book.name, book.author, book.keywords, book.price, book.stock);
+    }
+
+    // withSecondary 为 false 时只动 ISBN 表（改库存不影响其他索引）
+    void bookAdded(const std::string& isbn, const BookState& book, bool withSecondary) {
+        ops.push_back({ISBN_FILE, INSERT, isbn, 0, dataOf(isbn, book), FinanceRecord()});
+        if (!withSecondary) return;
+        ops.push_back({ID_FILE, INSERT, isbn, book.id, BookData(), FinanceRecord()});
+        if (!book.name.empty()) ops.push_back({NAME_FILE, INSERT, book.name, book.id, BookData(), FinanceRecord()});
+        if (!book.author.empty()) ops.push_back({AUTHOR_FILE, INSERT, book.author, book.id, BookData(), FinanceRecord()});
+        for (const std::string& keyword : splitKeywords(book.keywords)) {
+            ops.push_back({KEYWORD_FILE, INSERT, keyword, book.id, BookData(), FinanceRecord()});
+        }
+    }
+
+    void bookRemoved(const std::string& isbn, const BookState& book) {
+        ops.push_back({ISBN_FILE, REMOVE, isbn, 0, dataOf(isbn, book), FinanceRecord()});
+    }
+};
+
+// 内置指令流：随机建书、改书、进货、购买、查询
+std::vector<std::string> syntheticWorkload() {
+    std::mt19937 rng(2025);
+    std::vector<std::string> lines;
+    std::vector<std::string> isbns;
+    auto pick = [&](int n) { return static_cast<int>(rng() % n); };
+
+    for (int i = 0; i < 3000; i++) {
+        const std::string isbn = "978-" + std::to_string(1000000 + pick(9000000));
+        isbns.push_back(isbn);
+        lines.push_back("select " + isbn);
+        lines.push_back("modify -name=\"name" + std::to_string(pick(800)) + "\" -author=\"author" +
+                        std::to_string(pick(300)) + "\" -keyword=\"k" + std::to_string(pick(100)) + "|k" +
+                        std::to_string(100 + pick(100)) + "\" -price=" + std::to_string(1 + pick(200)) + ".50");
+        lines.push_back("import " + std::to_string(1 + pick(100)) + " 10.00");
+    }
+    for (int i = 0; i < 12000; i++) {
+        const std::string& isbn = isbns[pick(static_cast<int>(isbns.size()))];
+        const int r = pick(10);
+        if (r < 4) {
+            lines.push_back("buy " + isbn + " 1");
+        } else if (r < 6) {
+            lines.push_back("show -ISBN=" + isbn);
+        } else if (r < 7) {
+            lines.push_back("show -keyword=\"k" + std::to_string(pick(200)) + "\"");
+        } else if (r < 8) {
+            lines.push_back("show -name=\"name" + std::to_string(pick(800)) + "\"");
+        } else {
+            lines.push_back("select " + isbn);
+            lines.push_back("modify -keyword=\"k" + std::to_string(pick(200)) + "\"");
+        }
+    }
+    return lines;
+}
+
+template<size_t BlockBytes>
+struct IndexFiles {
+    Map<ISBNIndex, BookData, BlockBytes> isbn;
+    Map<int, ISBNIndex, BlockBytes> id;
+    Map<NameAuthorIndex, int, BlockBytes, FRONT_CODED> name;
+    Map<NameAuthorIndex, int, BlockBytes, FRONT_CODED> author;
+    Map<KeywordIndex, int, BlockBytes, FRONT_CODED> keyword;
+    Map<int, FinanceRecord, BlockBytes> finance;
+
+    explicit IndexFiles(const std::string& dir)
+        : isbn(dir + "/isbn"), id(dir + "/id"), name(dir + "/name"), author(dir + "/author"),
+          keyword(dir + "/keyword"), finance(dir + "/finance") {}
+
+    template<typename M, typename K, typename V>
+    static void apply(M& map, const Op& op, const K& key, const V& value) {
+        if (op.kind == INSERT) map.insert(key, value);
+        else if (op.kind == REMOVE) map.remove(key, value);
+        else map.find(key);
+    }
+
+    void apply(const Op& op) {
+        switch (op.index) {
+            case ISBN_FILE: apply(isbn, op, ISBNIndex(op.key), op.book); break;
+            case ID_FILE: apply(id, op, op.id, ISBNIndex(op.key)); break;
+            case NAME_FILE: apply(name, op, NameAuthorIndex(op.key), op.id); break;
+            case AUTHOR_FILE: apply(author, op, NameAuthorIndex(op.key), op.id); break;
+            case KEYWORD_FILE: apply(keyword, op, KeywordIndex(op.key), op.id); break;
+            case FINANCE_FILE: apply(finance, op, std::stoi(op.key), op.record); break;
+            default: break;
+        }
+    }
+};
+
+struct TierResult {
+    size_t blockBytes;
+    std::vector<uintmax_t> fileKB;    // 重放结束时各索引文件的大小
+    std::vector<double> millis;
+};
+
+// 在空目录里用给定块大小重放全部操作，分索引文件计时
+template<size_t BlockBytes>
+TierResult runTier(const std::vector<Op>& ops, const std::filesystem::path& root) {
+    const std::filesystem::path dir = root / std::to_string(BlockBytes >> 10);
+    std::filesystem::create_directories(dir);
+
+    TierResult result{BlockBytes, std::vector<uintmax_t>(INDEX_COUNT, 0), std::vector<double>(INDEX_COUNT, 0.0)};
+    {
+        IndexFiles<BlockBytes> files(dir.string());
+        for (const Op& op : ops) {
+            const auto start = std::chrono::steady_clock::now();
+            files.apply(op);
+            const auto end = std::chrono::steady_clock::now();
+            result.millis[op.index] += std::chrono::duration<double, std::milli>(end - start).count();
+        }
+    }
+    for (int index = 0; index < INDEX_COUNT; index++) {
+        result.fileKB[index] = std::filesystem::file_size(dir / INDEX_NAMES[index]) >> 10;
+    }
+    std::filesystem::remove_all(dir);
+    return result;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> lines;
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) {
+            std::ifstream in(argv[i]);
+            if (!in) {
+                std::cerr << "cannot open " << argv[i] << "\n";
+                return 1;
+            }
+            std::string line;
+            while (std::getline(in, line)) {
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                lines.push_back(line);
+            }
+        }
+    } else {
+        lines = syntheticWorkload();
+    }
+
+    Recorder recorder;
+    for (const std::string& line : lines) recorder.record(line);
+    std::cout << lines.size() << " commands, " << recorder.ops.size() << " index operations\n";
+
+    const std::filesystem::path root =
+        std::filesystem::temp_directory_path() / ("map_bench_" + std::to_string(::getpid()));
+    std::vector<TierResult> results = {
+        runTier<BLOCK_4K>(recorder.ops, root),
+        runTier<BLOCK_16K>(recorder.ops, root),
+        runTier<BLOCK_64K>(recorder.ops, root),
+        runTier<BLOCK_256K>(recorder.ops, root),
+    };
+    std::filesystem::remove_all(root);
+
+    std::cout << std::left << std::setw(10) << "index";
+    for (const TierResult& tier : results) {
+        std::cout << std::right << std::setw(20) << (std::to_string(tier.blockBytes >> 10) + "KB");
+    }
+    std::cout << std::right << std::setw(8) << "best" << "\n";
+
+    std::cout << std::fixed << std::setprecision(1);
+    for (int index = 0; index < INDEX_COUNT; index++) {
+        std::cout << std::left << std::setw(10) << INDEX_NAMES[index] << std::right;
+        size_t best = 0;
+        for (size_t t = 0; t < results.size(); t++) {
+            std::ostringstream cell;
+            cell << std::fixed << std::setprecision(1) << results[t].millis[index] << "ms/"
+                 << results[t].fileKB[index] << "KB";
+            std::cout << std::setw(20) << cell.str();
+            if (results[t].millis[index] < results[best].millis[index]) best = t;
+        }
+        std::cout << std::setw(8) << (std::to_string(results[best].blockBytes >> 10) + "KB") << "\n";
+    }
+    return 0;
+}
@@ -3,51 +3,221 @@
 
 #include <fstream>
 #include <utility>
+#include <mutex>
+#include <map>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "mvcc.h"
+#include "transaction.h"
+#include "resident_file.h"
+#include "io_ring.h"
+#include "arena.h"
 
 using std::string;
 using std::fstream;
 using std::ifstream;
 using std::ofstream;
 
+// 文件当前的大小与修改时间（纳秒）。过滤器、哈希索引这类附属结构保存时记下数据文件的这两项，
+// 打开时对不上说明数据在它们保存之后又被改过
+inline bool fileStamp(const string &path, int64_t &size, int64_t &mtime) {
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) return false;
+    size = st.st_size;
+    mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+    return true;
+}
+
+// 文件读写统一走 pread/pwrite：不共享文件偏移，多个线程可以同时读同一个文件
+// 有活跃读快照时，update/write_info 会先把旧内容留在内存里供快照读取（见 mvcc.h）
+// 事务内的写入只进入脏块表，提交时合并写出（见 transaction.h）
+// 异步读写模式下，批量读和事务提交的多段写经 io_uring 一次提交（见 io_ring.h）
 template<class T, int info_len = 4>
-class MemoryRiver {
+class MemoryRiver : public VersionedStore {
 private:
     /* your code here */
-    mutable fstream file;
+    mutable int fd = -1;
+    mutable std::shared_ptr<ResidentFile> resident;     // 常驻内存模式下文件的映像
+    mutable std::mutex openMutex;   // 保护首次打开文件
+    std::mutex appendMutex;         // 追加写需要原子地确定文件末尾
     string file_name;
     int sizeofT = sizeof(T);
+
+    // 旧版本：位置索引 -> 按淘汰版本升序排列的前像
+    struct Image {
+        long long obsoletedAt;
+        std::unique_ptr<T> data;
+    };
+    std::map<int, std::vector<Image>> images;
+    std::map<int, std::vector<std::pair<long long, int>>> infoImages;
+    mutable std::mutex versionMutex;
+
+    // 事务脏块表：位置索引 -> 新内容。只有事务所属会话的指令会访问，同一时刻至多一条
+    std::map<int, std::unique_ptr<T>> dirtyBlocks;
+    std::map<int, int> dirtyInfo;
+    int bufferedEnd = -1;   // 事务内下一次追加写的位置，-1 表示尚未追加
+
+    int handle() const {
+        std::lock_guard<std::mutex> lock(openMutex);
+        if (fd < 0) {
+            fd = ::open(file_name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        }
+        return fd;
+    }
+
+    // 常驻内存模式下的映像，否则为空
+    ResidentFile *residentFile() const {
+        if (!memoryResident) return nullptr;
+        std::lock_guard<std::mutex> lock(openMutex);
+        if (!resident) resident = ResidentFile::open(file_name);
+        return resident.get();
+    }
+
+    long long endOffset() const {
+        if (ResidentFile *file = residentFile()) return file->size();
+        return ::lseek(handle(), 0, SEEK_END);
+    }
+
+    void readAt(void *buf, size_t len, long long offset) const {
+        if (ResidentFile *file = residentFile()) {
+            file->read(buf, len, offset);
+            return;
+        }
+        char *p = static_cast<char *>(buf);
+        while (len > 0) {
+            const ssize_t n = ::pread(handle(), p, len, offset);
+            if (n <= 0) return;
+            p += n;
+            len -= n;
+            offset += n;
+        }
+    }
+
+    void writeAt(const void *buf, size_t len, long long offset) {
+        if (ResidentFile *file = residentFile()) {
+            file->write(buf, len, offset);
+            return;
+        }
+        const char *p = static_cast<const char *>(buf);
+        while (len > 0) {
+            const ssize_t n = ::pwrite(handle(), p, len, offset);
+            if (n <= 0) return;
+            p += n;
+            len -= n;
+            offset += n;
+        }
+    }
+
+    // 写者覆盖 index 处对象前调用（持有 versionMutex）。已有前像能满足所有活跃快照时不必再存
+    void keepPreImage(const int index) {
+        std::vector<Image> &list = images[index];
+        if (!list.empty() && list.back().obsoletedAt > currentNewestSnapshot) return;
+
+        std::unique_ptr<T> data(new T);
+        readAt(data.get(), sizeofT, index);
+        list.push_back({currentWriteVersion, std::move(data)});
+    }
+
+    // 同上，针对第 n 个 int
+    void keepInfoPreImage(const int n) {
+        auto &list = infoImages[n];
+        if (!list.empty() && list.back().first > currentNewestSnapshot) return;
+
+        int old = 0;
+        readAt(&old, sizeof(int), (n - 1) * sizeof(int));
+        list.emplace_back(currentWriteVersion, old);
+    }
+
+    // 快照读（持有 versionMutex）：若 index 处对象在快照之后被改过，取快照时刻的前像
+    bool readPreImage(T &t, const int index) const {
+        auto it = images.find(index);
+        if (it == images.end()) return false;
+        for (const Image &image : it->second) {
+            if (image.obsoletedAt > currentSnapshot) {
+                memcpy(reinterpret_cast<char *>(&t), image.data.get(), sizeofT);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 事务内的写入：覆盖脏块表中 index 处的内容
+    void bufferBlock(const T &t, const int index) {
+        std::unique_ptr<T> &slot = dirtyBlocks[index];
+        if (!slot) slot.reset(new T);
+        memcpy(reinterpret_cast<char *>(slot.get()), reinterpret_cast<const char *>(&t), sizeofT);
+    }
+
 public:
-    MemoryRiver() = default;
+    MemoryRiver() {
+        VersionClock::registerStore(this);
+    }
 
-    explicit MemoryRiver(string  file_name) : file_name(std::move(file_name)) {}
+    explicit MemoryRiver(string  file_name) : file_name(std::move(file_name)) {
+        VersionClock::registerStore(this);
+    }
+
+    ~MemoryRiver() override {
+        VersionClock::unregisterStore(this);
+        if (fd >= 0) ::close(fd);
+    }
+
+    MemoryRiver(const MemoryRiver &) = delete;
+    MemoryRiver &operator=(const MemoryRiver &) = delete;
 
     void initialise(string FN = "") {
         if (FN != "") file_name = FN;
-        file.open(file_name, std::ios::out);
+        if (ResidentFile *file = residentFile()) {
+            file->truncate();
+        } else if (::ftruncate(handle(), 0) != 0) {
+            return;
+        }
         int tmp = 0;
         for (int i = 0; i < info_len; ++i)
-            file.write(reinterpret_cast<char *>(&tmp), sizeof(int));
-        file.close();
+            writeAt(&tmp, sizeof(int), i * sizeof(int));
     }
 
     //读出第n个int的值赋给tmp，1_base
-    void get_info(int &tmp, int n) {
+    void get_info(int &tmp, int n) const {
         if (n > info_len) return;
         /* your code here */
-        file.open(file_name, std::ios::in );
-        file.seekg((n - 1) * sizeof(int));
-        file.read(reinterpret_cast<char*>(&tmp), sizeof(int));
-        file.close();
+        if (currentTransaction) {
+            auto it = dirtyInfo.find(n);
+            if (it != dirtyInfo.end()) {
+                tmp = it->second;
+                return;
+            }
+        }
+        std::lock_guard<std::mutex> lock(versionMutex);
+        if (currentSnapshot >= 0) {
+            auto it = infoImages.find(n);
+            if (it != infoImages.end()) {
+                for (const auto &image : it->second) {
+                    if (image.first > currentSnapshot) {
+                        tmp = image.second;
+                        return;
+                    }
+                }
+            }
+        }
+        readAt(&tmp, sizeof(int), (n - 1) * sizeof(int));
     }
 
     //将tmp写入第n个int的位置，1_base
     void write_info(int tmp, int n) {
         if (n > info_len) return;
         /* your code here */
-        file.open(file_name, std::ios::in | std::ios::out );
-        file.seekg((n - 1) * sizeof(int));
-        file.write(reinterpret_cast<char*>(&tmp), sizeof(int));
-        file.close();
+        if (currentTransaction) {
+            dirtyInfo[n] = tmp;
+            return;
+        }
+        std::lock_guard<std::mutex> lock(versionMutex);
+        if (currentNewestSnapshot >= 0) keepInfoPreImage(n);
+        writeAt(&tmp, sizeof(int), (n - 1) * sizeof(int));
     }
 
     //在文件合适位置写入类对象t，并返回写入的位置索引index
@@ -55,30 +225,113 @@ public:
     //位置索引index可以取为对象写入的起始位置
     int write(T &t) {
         /* your code here */
-        file.open(file_name,std::ios::in | std::ios::out );
-        file.seekp(0, std::ios::end);
-        const int index = file.tellp();
-        file.write(reinterpret_cast<char*>(&t), sizeofT);
-        file.close();
+        std::lock_guard<std::mutex> lock(appendMutex);
+        if (currentTransaction) {
+            if (bufferedEnd < 0) bufferedEnd = static_cast<int>(endOffset());
+            const int index = bufferedEnd;
+            bufferedEnd += sizeofT;
+            bufferBlock(t, index);
+            return index;
+        }
+        const int index = static_cast<int>(endOffset());
+        writeAt(&t, sizeofT, index);
+        return index;
+    }
+
+    //在文件末尾连续写入 n 个对象（一次 pwrite），返回第一个对象的位置索引
+    int write(const T *items, int n) {
+        std::lock_guard<std::mutex> lock(appendMutex);
+        if (currentTransaction) {
+            if (bufferedEnd < 0) bufferedEnd = static_cast<int>(endOffset());
+            const int index = bufferedEnd;
+            for (int i = 0; i < n; i++) {
+                bufferBlock(items[i], bufferedEnd);
+                bufferedEnd += sizeofT;
+            }
+            return index;
+        }
+        const int index = static_cast<int>(endOffset());
+        writeAt(items, static_cast<size_t>(sizeofT) * n, index);
         return index;
     }
 
+    // 常驻内存模式下立即把映像写回文件（之后才能按文件的大小与修改时间给附属结构盖戳），否则什么也不做
+    void checkpoint() {
+        if (ResidentFile *file = residentFile()) file->checkpoint();
+    }
+
+    //下一次追加写入的位置索引
+    int endIndex() {
+        std::lock_guard<std::mutex> lock(appendMutex);
+        if (currentTransaction && bufferedEnd >= 0) return bufferedEnd;
+        return static_cast<int>(endOffset());
+    }
+
     //用t的值更新位置索引index对应的对象，保证调用的index都是由write函数产生
     void update(T &t, const int index) {
         /* your code here */
-        file.open(file_name,std::ios::in | std::ios::out);
-        file.seekp(index, std::ios::beg);
-        file.write(reinterpret_cast<char *>(&t), sizeofT);
-        file.close();
+        if (currentTransaction) {
+            bufferBlock(t, index);
+            return;
+        }
+        if (currentNewestSnapshot >= 0) {
+            // 保存前像与覆盖写须是原子的，否则快照读者可能读到新内容
+            std::lock_guard<std::mutex> lock(versionMutex);
+            keepPreImage(index);
+            writeAt(&t, sizeofT, index);
+            return;
+        }
+        writeAt(&t, sizeofT, index);
     }
 
     //读出位置索引index对应的T对象的值并赋值给t，保证调用的index都是由write函数产生
     void read(T &t, const int index) const{
         /* your code here */
-        file.open(file_name,std::ios::in);
-        file.seekg(index, std::ios::beg);
-        file.read(reinterpret_cast<char *>(&t), sizeofT);
-        file.close();
+        if (currentTransaction) {
+            auto it = dirtyBlocks.find(index);
+            if (it != dirtyBlocks.end()) {
+                memcpy(reinterpret_cast<char *>(&t), it->second.get(), sizeofT);
+                return;
+            }
+        }
+        if (currentSnapshot >= 0) {
+            std::lock_guard<std::mutex> lock(versionMutex);
+            if (!readPreImage(t, index)) readAt(&t, sizeofT, index);
+            return;
+        }
+        readAt(&t, sizeofT, index);
+    }
+
+    //批量读出 n 个对象：items[i] 读位置索引 indices[i] 处的对象。事务脏块表里的、
+    //快照读者有前像的直接拷贝，其余一次提交
+    void read(T *const *items, const int *indices, const int n) const {
+        if (n == 1 || residentFile()) {
+            for (int i = 0; i < n; i++) read(*items[i], indices[i]);
+            return;
+        }
+        ArenaVector<IoRing::Request> requests;
+        requests.reserve(n);
+        // 与单个读一样，快照读者查前像与读文件须在 versionMutex 下一并完成
+        std::unique_lock<std::mutex> lock(versionMutex, std::defer_lock);
+        if (currentSnapshot >= 0) lock.lock();
+        for (int i = 0; i < n; i++) {
+            if (currentTransaction) {
+                auto it = dirtyBlocks.find(indices[i]);
+                if (it != dirtyBlocks.end()) {
+                    memcpy(reinterpret_cast<char *>(items[i]), it->second.get(), sizeofT);
+                    continue;
+                }
+            }
+            if (currentSnapshot >= 0 && readPreImage(*items[i], indices[i])) continue;
+            requests.push_back({handle(), false, items[i], static_cast<size_t>(sizeofT), indices[i]});
+        }
+        IoRing::run(requests);
+    }
+
+    //提示内核马上要读从位置索引 index 起的 n 个对象，提前读进页缓存，不等待读完。常驻内存模式下什么也不做
+    void prefetch(const int index, const int n) const {
+        if (n <= 0 || residentFile()) return;
+        ::posix_fadvise(handle(), index, static_cast<off_t>(sizeofT) * n, POSIX_FADV_WILLNEED);
     }
 
     //删除位置索引index对应的对象(不涉及空间回收时，可忽略此函数)，保证调用的index都是由write函数产生
@@ -87,6 +340,65 @@ public:
         T obj{};
         update(obj, index);
     }
+
+    // 提交事务：脏块按地址顺序写出，地址相连的块合并成一次 pwrite。
+    // 各段互不重叠，先留好前像再一起提交写出
+    void flushBuffered() {
+        std::lock_guard<std::mutex> lock(versionMutex);
+        const int fileEnd = static_cast<int>(endOffset());
+
+        std::vector<std::pair<int, std::vector<char>>> runs;
+        for (auto &[index, data] : dirtyBlocks) {
+            if (runs.empty() || index != runs.back().first + static_cast<int>(runs.back().second.size())) {
+                runs.emplace_back(index, std::vector<char>());
+            }
+            if (currentNewestSnapshot >= 0 && index < fileEnd) keepPreImage(index);
+
+            const char *bytes = reinterpret_cast<const char *>(data.get());
+            runs.back().second.insert(runs.back().second.end(), bytes, bytes + sizeofT);
+        }
+        if (residentFile()) {
+            for (auto &[start, run] : runs) writeAt(run.data(), run.size(), start);
+        } else {
+            std::vector<IoRing::Request> requests;
+            requests.reserve(runs.size());
+            for (auto &[start, run] : runs) requests.push_back({handle(), true, run.data(), run.size(), start});
+            IoRing::run(requests);
+        }
+
+        for (auto &[n, value] : dirtyInfo) {
+            if (currentNewestSnapshot >= 0) keepInfoPreImage(n);
+            writeAt(&value, sizeof(int), (n - 1) * sizeof(int));
+        }
+        dirtyBlocks.clear();
+        dirtyInfo.clear();
+        bufferedEnd = -1;
+    }
+
+    // 回滚事务：丢弃脏块表
+    void discardBuffered() {
+        dirtyBlocks.clear();
+        dirtyInfo.clear();
+        bufferedEnd = -1;
+    }
+
+    void pruneVersions(long long oldest) override {
+        std::lock_guard<std::mutex> lock(versionMutex);
+        for (auto it = images.begin(); it != images.end();) {
+            auto &list = it->second;
+            list.erase(std::remove_if(list.begin(), list.end(),
+                                      [oldest](const Image &image) { return image.obsoletedAt <= oldest; }),
+                       list.end());
+            it = list.empty() ? images.erase(it) : std::next(it);
+        }
+        for (auto it = infoImages.begin(); it != infoImages.end();) {
+            auto &list = it->second;
+            list.erase(std::remove_if(list.begin(), list.end(),
+                                      [oldest](const std::pair<long long, int> &image) { return image.first <= oldest; }),
+                       list.end());
+            it = list.empty() ? infoImages.erase(it) : std::next(it);
+        }
+    }
 };
 
 
@@ -10,6 +10,7 @@
 #include <cstring>
 #include <cctype>
 #include <algorithm>
+#include <mutex>
 #include "map.h"
 #include "MemoryRiver.h"
 #include "book.h"
@@ -64,82 +65,13 @@ public:
     }
 };
 
-class CharIndex {
-private:
-    char data[MAX_INDEX_LEN] = {0};
-
-public:
-    CharIndex() {
-        data[0] = '\0';
-    }
-
-    CharIndex(const std::string &str) {
-        strncpy(data, str.c_str(), MAX_INDEX_LEN - 1);
-        data[MAX_INDEX_LEN - 1] = '\0';
-    }
-
-    CharIndex(const char* str) {
-        if (str) {
-            strncpy(data, str, MAX_INDEX_LEN - 1);
-            data[MAX_INDEX_LEN - 1] = '\0';
-        } else {
-            data[0] = '\0';
-        }
-    }
-
-    CharIndex(const CharIndex &other) {
-        strncpy(data, other.data, MAX_INDEX_LEN);
-    }
-
-    CharIndex& operator=(const CharIndex &other) {
-        if (this != &other) {
-            strncpy(data, other.data, MAX_INDEX_LEN);
-        }
-        return *this;
-    }
-
-    bool operator<(const CharIndex &other) const {
-        return strcmp(data, other.data) < 0;
-    }
-
-    bool operator>(const CharIndex &other) const {
-        return strcmp(data, other.data) > 0;
-    }
-
-    bool operator<=(const CharIndex &other) const {
-        return strcmp(data, other.data) <= 0;
-    }
-
-    bool operator>=(const CharIndex &other) const {
-        return strcmp(data, other.data) >= 0;
-    }
-
-    bool operator==(const CharIndex &other) const {
-        return strcmp(data, other.data) == 0;
-    }
-
-    bool operator!=(const CharIndex &other) const {
-        return strcmp(data, other.data) != 0;
-    }
-
-    friend std::ostream& operator<<(std::ostream &os, const CharIndex &obj) {
-        os << obj.data;
-        return os;
-    }
-
-    const char* c_str() const {
-        return data;
-    }
-
-    bool empty() const {
-        return data[0] == '\0';
-    }
-};
+using CharIndex = FixedString<MAX_INDEX_LEN>;
 
 class LoginInfo {
 private:
     Account account;
     std::string selectedISBN;
+    BookHandle selectedBook;    // 选中图书在 ISBN 表中的句柄，可能已失效
 
 public:
     LoginInfo() : account(Account()), selectedISBN("") {}
@@ -148,17 +80,33 @@ public:
 
     Account getAccount() const { return account; }
     std::string getSelectedISBN() const { return selectedISBN; }
-    void setSelectedISBN(const std::string& isbn) { selectedISBN = isbn; }
-    void clearSelectedISBN() { selectedISBN = ""; }
+    const BookHandle& getSelectedHandle() const { return selectedBook; }
+    void setSelectedISBN(const std::string& isbn, const BookHandle& handle = BookHandle()) {
+        selectedISBN = isbn;
+        selectedBook = handle;
+    }
+    void setSelectedHandle(const BookHandle& handle) { selectedBook = handle; }
+    void clearSelectedISBN() {
+        selectedISBN = "";
+        selectedBook = BookHandle();
+    }
 };
 
+using LoginStack = std::vector<LoginInfo>;
+
 class AccountSystem {
     friend class Bookstore;
 private:
+    // 注册、添加用户时查的多是不存在的用户，带键过滤器；登录等按用户名查找经哈希索引直达所在块
     Map<CharIndex, Account> accountMap;
-    std::vector<LoginInfo> loginStack;
+    mutable LoginStack consoleStack;         // 标准输入会话的登录栈
+    std::vector<LoginStack*> sessionStacks;  // 所有会话的登录栈
+    mutable std::mutex sessionMutex;         // 保护 sessionStacks
     std::string accountFile;
 
+    // 当前线程正在执行指令的会话的登录栈
+    LoginStack* currentStack() const;
+
 
     //验证函数
     bool isValidUserID(const std::string& uid) const;
@@ -196,8 +144,10 @@ public:
     bool isLoggedIn() const;
 
     // 图书选择相关
-    bool selectBook(const std::string& ISBN);
+    bool selectBook(const std::string& ISBN, const BookHandle& handle = BookHandle());
     std::string getSelectedISBN() const;
+    BookHandle getSelectedHandle() const;
+    void setSelectedHandle(const BookHandle& handle);
     void clearSelectedBook();
 
     // 登录栈操作
@@ -208,6 +158,11 @@ public:
 
     void updateSelectedISBNForAll(const std::string& oldISBN, const std::string& newISBN);
 
+    // 多会话：每个连接持有自己的登录栈，执行指令前把当前线程切换到该栈
+    void attachSession(LoginStack* stack);
+    void detachSession(LoginStack* stack);
+    void switchSession(LoginStack* stack);
+
     std::vector<Account> getAllAccounts() const {
         return accountMap.getAllValues();
     }
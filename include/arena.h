@@ -0,0 +1,141 @@
+#ifndef BOOKSTORE_2025_ARENA_H
+#define BOOKSTORE_2025_ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// 指令内临时对象的区域分配
+// 分词结果、维护索引时的关键词表、show 的结果表、批量读块时的地址表这类对象只活到指令结束。
+// 它们从当前线程的区域里按指针递增分配，释放什么也不做；指令结束时（CommandArena 析构）区域整体复位，
+// 申请过的块留给下一条指令，稳定运行后这些容器本身不再调用 malloc/free。
+// 指令的其余部分仍会走堆：存进帐户表、日志、查询缓存的 std::string，链表查值的结果等。
+// 没有 CommandArena 的线程或时段（启动、后台合并线程）里构造的容器照常走堆。
+// 从区域分配的对象不能活过所在的指令：要存进查询缓存等长期结构的仍用 std::string / std::vector
+class Arena {
+private:
+    static constexpr size_t CHUNK_BYTES = 64 << 10;
+    static constexpr size_t MAX_KEPT_CHUNKS = 16;   // 复位后最多留下的块数
+
+    struct Chunk {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    std::vector<Chunk> chunks;
+    size_t current = 0;     // 正在分配的块
+    size_t used = 0;        // 该块已用的字节数
+
+    // 在 chunk 的 used 之后按 align 对齐取 bytes 字节，放不下时返回空
+    static void *carve(const Chunk &chunk, size_t &used, const size_t bytes, const size_t align) {
+        const uintptr_t base = reinterpret_cast<uintptr_t>(chunk.data.get());
+        const uintptr_t at = (base + used + align - 1) & ~(static_cast<uintptr_t>(align) - 1);
+        if (at + bytes > base + chunk.size) return nullptr;
+        used = at + bytes - base;
+        return reinterpret_cast<void *>(at);
+    }
+
+public:
+    Arena() = default;
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    void *allocate(const size_t bytes, const size_t align) {
+        for (; current < chunks.size(); current++, used = 0) {
+            if (void *p = carve(chunks[current], used, bytes, align)) return p;
+        }
+        // 超过一块的大对象单独占一块
+        const size_t size = std::max(CHUNK_BYTES, bytes + align);
+        chunks.push_back({std::unique_ptr<char[]>(new char[size]), size});
+        current = chunks.size() - 1;
+        used = 0;
+        return carve(chunks[current], used, bytes, align);
+    }
+
+    // 丢弃全部分配。普通大小的块留着复用，单独给大对象开的块和多出来的块还给堆
+    void reset() {
+        chunks.erase(std::remove_if(chunks.begin(), chunks.end(),
+                                    [](const Chunk &chunk) { return chunk.size > CHUNK_BYTES; }),
+                     chunks.end());
+        if (chunks.size() > MAX_KEPT_CHUNKS) chunks.resize(MAX_KEPT_CHUNKS);
+        current = 0;
+        used = 0;
+    }
+
+    // 当前线程正在执行的指令所用的区域，不在指令中时为空
+    static Arena *&active() {
+        thread_local Arena *arena = nullptr;
+        return arena;
+    }
+};
+
+// 一条指令的作用域：期间当前线程的 ArenaAllocator 都从本线程的区域分配，析构时复位区域。
+// 嵌套时只有最外层生效
+class CommandArena {
+private:
+    bool outermost;
+
+public:
+    CommandArena() : outermost(Arena::active() == nullptr) {
+        thread_local Arena arena;
+        if (outermost) Arena::active() = &arena;
+    }
+
+    ~CommandArena() {
+        if (!outermost) return;
+        Arena *arena = Arena::active();
+        Arena::active() = nullptr;
+        arena->reset();
+    }
+
+    CommandArena(const CommandArena &) = delete;
+    CommandArena &operator=(const CommandArena &) = delete;
+};
+
+// 构造时取当前线程的区域（没有则走堆），容器拷贝时沿用同一个区域。
+// 赋值、交换时分配器不跟着走（propagate_* 为 false）：赋值给另一个容器时按目标自己的分配器逐个复制，
+// 不会把区域内存带进活得更久的容器。交换只能在同一区域的容器之间进行。
+// 区域容器与 std::vector / std::string 类型不同，要存进长期结构时须显式转换
+template<typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::false_type;
+    using propagate_on_container_move_assignment = std::false_type;
+    using propagate_on_container_swap = std::false_type;
+    using is_always_equal = std::false_type;
+
+    Arena *arena;
+
+    ArenaAllocator() noexcept : arena(Arena::active()) {}
+
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) noexcept : arena(other.arena) {}
+
+    T *allocate(const size_t n) {
+        if (arena) return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T)));
+        return static_cast<T *>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, size_t) noexcept {
+        if (!arena) ::operator delete(p);
+    }
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U> &other) const noexcept { return arena == other.arena; }
+
+    template<typename U>
+    bool operator!=(const ArenaAllocator<U> &other) const noexcept { return arena != other.arena; }
+};
+
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+using ArenaString = std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>;
+
+#endif //BOOKSTORE_2025_ARENA_H
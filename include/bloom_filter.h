@@ -0,0 +1,118 @@
+#ifndef BOOKSTORE_2025_BLOOM_FILTER_H
+#define BOOKSTORE_2025_BLOOM_FILTER_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include "MemoryRiver.h"
+
+// 键的布隆过滤器：查一个不存在的键时多半在这里就能断定，不必沿链表读块
+// 每个键 10 位、7 个哈希，误判率约 1%。只能加不能删：删掉的键留在里面只会多几次误判，
+// 加入的键数超过容量时由使用者按现有键重建，顺带清掉删过的键。
+// 位数组用原子字，读者与写者可以并发访问
+class BloomFilter {
+private:
+    static constexpr int HASHES = 7;
+    static constexpr size_t BITS_PER_KEY = 10;
+    static constexpr size_t MIN_WORDS = 1024;       // 至少 64K 位
+    static constexpr uint32_t MAGIC = 0x424C4D31;   // "BLM1"
+
+    // 写在过滤器文件头。数据文件的大小与修改时间对不上说明保存之后数据又被改过，过滤器作废
+    struct Header {
+        uint32_t magic;
+        uint32_t hashes;
+        uint64_t words;
+        uint64_t added;
+        int64_t dataSize;
+        int64_t dataMtime;
+    };
+
+    size_t words = 0;
+    std::unique_ptr<std::atomic<uint64_t>[]> bits;
+    std::atomic<size_t> added{0};
+
+    void allocate(const size_t count) {
+        words = count;
+        bits.reset(new std::atomic<uint64_t>[words]);
+        for (size_t i = 0; i < words; i++) bits[i].store(0, std::memory_order_relaxed);
+        added = 0;
+    }
+
+public:
+    explicit BloomFilter(const size_t expectedKeys = 0) { reset(expectedKeys); }
+
+    // 清空并按预计的键数重新定大小（留一倍余量，位数取 2 的幂）
+    void reset(const size_t expectedKeys) {
+        size_t count = MIN_WORDS;
+        while (count * 64 < expectedKeys * 2 * BITS_PER_KEY) count *= 2;
+        allocate(count);
+    }
+
+    void add(const uint64_t hash) {
+        const uint64_t mask = words * 64 - 1;
+        const uint64_t step = (hash >> 32) | 1;
+        uint64_t pos = hash;
+        for (int i = 0; i < HASHES; i++, pos += step) {
+            const uint64_t bit = pos & mask;
+            bits[bit >> 6].fetch_or(1ULL << (bit & 63), std::memory_order_relaxed);
+        }
+        added.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    bool mayContain(const uint64_t hash) const {
+        const uint64_t mask = words * 64 - 1;
+        const uint64_t step = (hash >> 32) | 1;
+        uint64_t pos = hash;
+        for (int i = 0; i < HASHES; i++, pos += step) {
+            const uint64_t bit = pos & mask;
+            if (!(bits[bit >> 6].load(std::memory_order_relaxed) & (1ULL << (bit & 63)))) return false;
+        }
+        return true;
+    }
+
+    // 加入的键数超出设计容量，误判率开始上升
+    bool overloaded() const { return added.load(std::memory_order_relaxed) * BITS_PER_KEY > words * 64; }
+
+    // 读入为 dataFile 保存的过滤器；文件缺失、损坏或数据文件之后改过都返回 false
+    bool load(const std::string& path, const std::string& dataFile) {
+        FILE* in = std::fopen(path.c_str(), "rb");
+        if (!in) return false;
+        Header header;
+        int64_t size, mtime;
+        bool ok = std::fread(&header, sizeof(header), 1, in) == 1 && header.magic == MAGIC &&
+                  header.hashes == HASHES && header.words >= MIN_WORDS &&
+                  (header.words & (header.words - 1)) == 0 && fileStamp(dataFile, size, mtime) &&
+                  header.dataSize == size && header.dataMtime == mtime;
+        if (ok) {
+            std::unique_ptr<uint64_t[]> raw(new uint64_t[header.words]);
+            ok = std::fread(raw.get(), sizeof(uint64_t), header.words, in) == header.words;
+            if (ok) {
+                allocate(header.words);
+                for (size_t i = 0; i < words; i++) bits[i].store(raw[i], std::memory_order_relaxed);
+                added = header.added;
+            }
+        }
+        std::fclose(in);
+        return ok;
+    }
+
+    // 数据文件写完之后保存，记下它此刻的大小与修改时间
+    void save(const std::string& path, const std::string& dataFile) const {
+        Header header{MAGIC, HASHES, words, added.load(), 0, 0};
+        if (!fileStamp(dataFile, header.dataSize, header.dataMtime)) return;
+        std::unique_ptr<uint64_t[]> raw(new uint64_t[words]);
+        for (size_t i = 0; i < words; i++) raw[i] = bits[i].load(std::memory_order_relaxed);
+
+        FILE* out = std::fopen(path.c_str(), "wb");
+        if (!out) return;
+        const bool ok = std::fwrite(&header, sizeof(header), 1, out) == 1 &&
+                        std::fwrite(raw.get(), sizeof(uint64_t), words, out) == words;
+        std::fclose(out);
+        if (!ok) std::remove(path.c_str());
+    }
+};
+
+#endif //BOOKSTORE_2025_BLOOM_FILTER_H
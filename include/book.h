@@ -7,7 +7,13 @@
 #include <cstring>
 #include <algorithm>
 #include <iomanip>
+#include <atomic>
 #include "map.h"
+#include "lsm_store.h"
+#include "fixed_string.h"
+#include "output.h"
+#include "query_cache.h"
+#include "arena.h"
 
 class BookData {
 private:
@@ -33,6 +39,7 @@ public:
     std::string getKeywords() const;
     double getPrice() const;
     long long getStock() const;
+    int getBookId() const { return book_id; }
 
     // 设置信息
     void setISBN(const std::string& isbn);
@@ -41,6 +48,7 @@ public:
     void setKeywords(const std::string& keywords);
     void setPrice(double price);
     void setStock(long long stock);
+    void setBookId(int id) { book_id = id; }
 
     bool increaseStock(long long quantity);
     bool decreaseStock(long long quantity);
@@ -48,9 +56,11 @@ public:
     bool isValid() const;
     bool hasKeyword(const std::string& keyword) const;
 
-    std::vector<std::string> getAllKeywords() const;
+    ArenaVector<std::string> getAllKeywords() const;
 
     std::string toString() const;
+    // 把 toString() 的内容接在 out 末尾，不另建字符串
+    void appendTo(std::string& out) const;
 
     bool operator<(const BookData& other) const {
         return strcmp(ISBN, other.ISBN) < 0;
@@ -65,213 +75,117 @@ public:
     friend std::ostream& operator<<(std::ostream& os, const BookData& book);
 };
 
-class ISBNIndex {
-private:
-    char data[21] = {0};
-
-public:
-    ISBNIndex() { data[0] = '\0'; }
-
-    ISBNIndex(const std::string& str) {
-        strncpy(data, str.c_str(), 20);
-        data[20] = '\0';
-    }
-
-    ISBNIndex(const char* str) {
-        if (str) {
-            strncpy(data, str, 20);
-            data[20] = '\0';
-        } else {
-            data[0] = '\0';
-        }
-    }
-
-    const char* c_str() const { return data; }
-    std::string toString() const { return std::string(data); }
-
-    bool operator<(const ISBNIndex& other) const {
-        return strcmp(data, other.data) < 0;
-    }
-
-    bool operator==(const ISBNIndex& other) const {
-        return strcmp(data, other.data) == 0;
-    }
-
-    bool operator!=(const ISBNIndex& other) const {
-        return strcmp(data, other.data) != 0;
-    }
-    bool operator<=(const ISBNIndex& other) const {
-        return strcmp(data, other.data) <= 0;
-    }
-
-    bool operator>(const ISBNIndex& other) const {
-        return strcmp(data, other.data) > 0;
-    }
+// 图书相关的定长键，比较见 fixed_string.h
+using ISBNIndex = FixedString<21>;
+using NameAuthorIndex = FixedString<61>;
+using KeywordIndex = FixedString<61>;
 
-    bool operator>=(const ISBNIndex& other) const {
-        return strcmp(data, other.data) >= 0;
-    }
-
-    bool empty() const { return data[0] == '\0'; }
-
-    friend std::ostream& operator<<(std::ostream& os, const ISBNIndex& idx) {
-        os << idx.data;
-        return os;
-    }
+// 加上交易时刻之前的财务记录（16 字节），只用于读出旧数据文件
+struct LegacyFinanceRecord {
+    double income;
+    double expense;
 };
 
-class NameAuthorIndex {
-private:
-    char data[61] = {0};
-
-public:
-    NameAuthorIndex() {
-        data[0] = '\0';
-    }
-
-    NameAuthorIndex(const std::string& str) {
-        strncpy(data, str.c_str(), 60);
-        data[60] = '\0';
-    }
-
-    NameAuthorIndex(const char* str) {
-        if (str) {
-            strncpy(data, str, 60);
-            data[60] = '\0';
-        } else {
-            data[0] = '\0';
-        }
-    }
-
-    NameAuthorIndex(const NameAuthorIndex& other) {
-        strncpy(data, other.data, 61);
-    }
-
-    NameAuthorIndex& operator=(const NameAuthorIndex& other) {
-        if (this != &other) {
-            strncpy(data, other.data, 61);
-        }
-        return *this;
-    }
-
-    const char* c_str() const { return data; }
-    std::string toString() const { return std::string(data); }
-
-    bool empty() const { return data[0] == '\0'; }
-
-    bool operator<(const NameAuthorIndex& other) const {
-        return strcmp(data, other.data) < 0;
-    }
-
-    bool operator<=(const NameAuthorIndex& other) const {
-        return strcmp(data, other.data) <= 0;
-    }
+struct FinanceRecord {
+    // 旧记录没有交易时刻，一律记为 0（1970-01-01），落不进任何实际查询的时间区间
+    static constexpr long long UNKNOWN_TIME = 0;
 
-    bool operator>(const NameAuthorIndex& other) const {
-        return strcmp(data, other.data) > 0;
-    }
+    double income;
+    double expense;
+    long long time;     // 交易发生时刻（Unix 时间戳，秒）
 
-    bool operator>=(const NameAuthorIndex& other) const {
-        return strcmp(data, other.data) >= 0;
-    }
+    FinanceRecord() : income(0.0), expense(0.0), time(UNKNOWN_TIME) {}
+    FinanceRecord(double inc, double exp, long long t = UNKNOWN_TIME) : income(inc), expense(exp), time(t) {}
+    explicit FinanceRecord(const LegacyFinanceRecord& legacy)
+        : income(legacy.income), expense(legacy.expense), time(UNKNOWN_TIME) {}
 
-    bool operator==(const NameAuthorIndex& other) const {
-        return strcmp(data, other.data) == 0;
+    bool operator<(const FinanceRecord& other) const {
+        if (income != other.income) return income < other.income;
+        return expense < other.expense;
     }
 
-    bool operator!=(const NameAuthorIndex& other) const {
-        return strcmp(data, other.data) != 0;
+    bool operator==(const FinanceRecord& other) const {
+        return income == other.income && expense == other.expense;
     }
 
-    friend std::ostream& operator<<(std::ostream& os, const NameAuthorIndex& idx) {
-        os << idx.data;
+    friend std::ostream& operator<<(std::ostream& os, const FinanceRecord& record) {
+        os << "+" << record.income << " -" << record.expense;
         return os;
     }
 };
 
+// 单本书的累计销量与销售额
+struct SalesRecord {
+    long long units;
+    double revenue;
 
-class KeywordIndex {
-private:
-    char data[61] = {0};
+    SalesRecord() : units(0), revenue(0.0) {}
+    SalesRecord(long long u, double r) : units(u), revenue(r) {}
 
-public:
-    KeywordIndex() { data[0] = '\0'; }
-
-    explicit KeywordIndex(const std::string& str) {
-        strncpy(data, str.c_str(), 60);
-        data[60] = '\0';
-    }
-
-    explicit KeywordIndex(const char* str) {
-        if (str) {
-            strncpy(data, str, 60);
-            data[60] = '\0';
-        } else {
-            data[0] = '\0';
-        }
-    }
-
-    const char* c_str() const { return data; }
-    std::string toString() const { return std::string(data); }
-
-    bool operator<(const KeywordIndex& other) const {
-        return strcmp(data, other.data) < 0;
+    bool operator<(const SalesRecord& other) const {
+        if (units != other.units) return units < other.units;
+        return revenue < other.revenue;
     }
 
-    bool operator==(const KeywordIndex& other) const {
-        return strcmp(data, other.data) == 0;
-    }
-
-    bool operator!=(const KeywordIndex& other) const {
-        return strcmp(data, other.data) != 0;
-    }
-
-    bool operator<=(const KeywordIndex& other) const {
-        return strcmp(data, other.data) <= 0;
-    }
-
-    bool operator>(const KeywordIndex& other) const {
-        return strcmp(data, other.data) > 0;
-    }
-
-    bool operator>=(const KeywordIndex& other) const {
-        return strcmp(data, other.data) >= 0;
-    }
-
-    bool empty() const { return data[0] == '\0'; }
-
-    friend std::ostream& operator<<(std::ostream& os, const KeywordIndex& idx) {
-        os << idx.data;
-        return os;
+    bool operator==(const SalesRecord& other) const {
+        return units == other.units && revenue == other.revenue;
     }
 };
 
-struct FinanceRecord {
+// 按时间分桶的财务汇总，键为桶起始时刻（本地时间，秒）
+struct FinanceBucket {
     double income;
     double expense;
+    int count;
 
-    FinanceRecord() : income(0.0), expense(0.0) {}
-    FinanceRecord(double inc, double exp) : income(inc), expense(exp) {}
+    FinanceBucket() : income(0.0), expense(0.0), count(0) {}
+    FinanceBucket(double inc, double exp, int cnt) : income(inc), expense(exp), count(cnt) {}
 
-    bool operator<(const FinanceRecord& other) const {
+    bool operator<(const FinanceBucket& other) const {
+        if (count != other.count) return count < other.count;
         if (income != other.income) return income < other.income;
         return expense < other.expense;
     }
 
-    bool operator==(const FinanceRecord& other) const {
-        return income == other.income && expense == other.expense;
+    bool operator==(const FinanceBucket& other) const {
+        return income == other.income && expense == other.expense && count == other.count;
     }
 
-    friend std::ostream& operator<<(std::ostream& os, const FinanceRecord& record) {
-        os << "+" << record.income << " -" << record.expense;
-        return os;
+    void add(const FinanceBucket& other) {
+        income += other.income;
+        expense += other.expense;
+        count += other.count;
     }
 };
 
 class FinanceSystem {
+public:
+    static constexpr long long MINUTE = 60;
+    static constexpr long long HOUR = 3600;
+    static constexpr long long DAY = 86400;
+
 private:
-    Map<int, FinanceRecord> financeMap;  // 使用Map存储财务记录
-    int transactionCount;                // 交易总数
+    // 交易编号单调递增、只追加，用 LSM 存储：插入只写内存表与日志（见 lsm_store.h）
+    LsmStore<int, FinanceRecord> financeMap;
+    std::atomic<int> transactionCount;   // 交易总数，快照读者可能并发读取
+
+    // 分钟/小时/天三级汇总表
+    Map<long long, FinanceBucket> minuteRollup;
+    Map<long long, FinanceBucket> hourRollup;
+    Map<long long, FinanceBucket> dayRollup;
+
+    static void addToRollup(Map<long long, FinanceBucket>& rollup, long long bucketStart,
+                            const FinanceBucket& delta);
+    static void sumRollup(const Map<long long, FinanceBucket>& rollup, long long from, long long to,
+                          FinanceBucket& total);
+    const Map<long long, FinanceBucket>& rollupOf(long long span) const;
+
+    // 累加编号在 [from, to] 内的交易
+    void sumRecords(int from, int to, double& income, double& expense) const;
+
+    // 旧版本把财务记录存在 Map 文件 fileName 中，读出装进 LSM 存储后删除。
+    // 块格式标记为 0 的是最早的格式，记录可能还没有交易时刻，按 LegacyFinanceRecord 读
+    void migrateFinanceMap(const std::string& fileName);
 
 public:
     explicit FinanceSystem(const std::string& baseFileName);
@@ -288,6 +202,20 @@ public:
     // 获取记录数量
     int getRecordCount() const { return transactionCount; }
 
+    // 统计本地时间 [from, to) 内的收支，用能覆盖区间的最粗粒度桶拼出
+    FinanceBucket getRangeSummary(long long from, long long to) const;
+
+    // 显示时间区间内的收支；span > 0 时按该粒度逐桶列出
+    bool showFinanceRange(long long from, long long to, long long span = 0) const;
+
+    // 把 Unix 时间戳换算成“本地时间秒数”，使整除 DAY 恰好落在本地零点
+    static long long toLocalSeconds(long long unixTime);
+
+    // 解析 YYYY-MM-DD / YYYY-MM-DDTHH / YYYY-MM-DDTHH:MM，得到起点与该精度的跨度
+    static bool parseTimeStr(const std::string& str, long long& start, long long& span);
+
+    static std::string formatTime(long long localSeconds, long long span);
+
     static std::string formatDouble(double value);
 
 
@@ -300,20 +228,58 @@ public:
         return financeMap.find(transactionId);
     }
 
-private:
-    // 更新交易计数
+    // 按交易顺序（从旧到新）逐条访问财务记录
+    template<typename Visitor>
+    void forEachRecord(Visitor visit) const {
+        financeMap.forEach([&](const int&, const FinanceRecord& record) { visit(record); });
+    }
+
+    // 更新交易计数（回滚事务后按文件重新统计）
     void updateTransactionCount();
 };
 
+// 图书记录在 ISBN 表中的句柄，选中图书后留在登录栈里，import/modify 凭它直接读写记录
+using BookHandle = Map<ISBNIndex, BookData, BLOCK_64K>::Handle;
+
 class BookSystem {
 private:
-    Map<ISBNIndex, BookData> isbnMap;
-    Map<NameAuthorIndex, ISBNIndex> nameIndex;
-    Map<NameAuthorIndex, ISBNIndex> authorIndex;
-    Map<KeywordIndex, ISBNIndex> keywordIndex;
+    // 值较大，map_bench 测得 64 KB 块最快。select 新书、改 ISBN 时查的多是不存在的 ISBN，带键过滤器；
+    // 按 ISBN 精确查找经哈希索引直达所在块
+    Map<ISBNIndex, BookData, BLOCK_64K> isbnMap;
+    // 每本书建书时分配一个不再改变的编号（记在 BookData 中），其余索引都只存编号，
+    // 改 ISBN 时只需改 ISBN 表和这张编号 -> ISBN 表。按编号取书（搜索、畅销榜）经哈希索引
+    Map<int, ISBNIndex> idIndex;
+    int nextBookId;
+    // 字符串索引的键多为短串且相邻键前缀相同，块内做前缀压缩
+    Map<NameAuthorIndex, int, BLOCK_16K, FRONT_CODED> nameIndex;
+    Map<NameAuthorIndex, int, BLOCK_16K, FRONT_CODED> authorIndex;
+    Map<KeywordIndex, int, BLOCK_16K, FRONT_CODED> keywordIndex;
+    // 有序的价格、库存索引，每本书各一条，供区间查询
+    Map<double, int> priceIndex;
+    Map<long long, int> stockIndex;
+
+    // 销量统计：编号 -> 累计销量/销售额（带哈希索引）；销量排行以 -销量 为键，表头即畅销榜首
+    Map<int, SalesRecord> salesMap;
+    Map<long long, int> salesRank;
 
     FinanceSystem financeSystem;
 
+    // show 查询结果缓存
+    QueryCache queryCache;
+
+    void migrateToBookIds(const std::string& baseFileName);
+    void loadIndices(const std::vector<BookData>& books);
+    void updateNextBookId();
+    template<typename Visitor>
+    void forEachBookOf(std::vector<int> ids, Visitor visit) const;
+    void updateStockIndex(int id, long long oldStock, long long newStock);
+    bool showRange(const std::string& type, const std::string& value);
+
+    void recordSale(int id, long long quantity, double total);
+
+    bool readSelected(const ISBNIndex& isbn, BookHandle& handle, BookData& book) const;
+    void writeSelected(const ISBNIndex& isbn, const BookHandle& handle, const BookData& book);
+
 public:
     explicit BookSystem(const std::string& baseFileName);
     static bool isValidISBNStr(const std::string& isbn);
@@ -326,24 +292,31 @@ public:
     void updateIndices(const BookData& oldBook, const BookData& newBook);
     void addToIndices(const BookData& book);
     void removeFromIndices(const BookData& book);
-    std::vector<std::string> splitKeywords(const std::string& keywords) const;
+    ArenaVector<std::string> splitKeywords(const std::string& keywords) const;
 
     std::vector<BookData> getAllBooksFromMap() const;
     //图书指令
     bool showBooks(const std::string& type, const std::string& value);
     bool buyBook(const std::string& isbnStr, long long quantity, double& total);
-    bool selectBook(const std::string& isbnStr);
-    bool modifyBook(const std::string& selectedISBN,
+    // 选中图书（不存在则新建），handle 返回记录的句柄
+    bool selectBook(const std::string& isbnStr, BookHandle& handle);
+    // handle 为选中图书的句柄，失效时按 ISBN 重新定位并写回
+    bool modifyBook(const std::string& selectedISBN, BookHandle& handle,
                     const std::vector<std::pair<std::string, std::string>>& modifications);
-    bool importBook(const std::string& selectedISBN, long long quantity, double totalCost);
+    bool importBook(const std::string& selectedISBN, BookHandle& handle, long long quantity, double totalCost);
+    // 从 TSV/CSV 目录文件批量建书（每行 ISBN、书名、作者、关键词、价格），各索引整体重建
+    bool loadCatalog(const std::string& path);
+    // 把全部图书写到文件，order 为 ISBN/price/stock/name；非 ISBN 序走定内存外部排序
+    bool exportCatalog(const std::string& path, const std::string& order) const;
+    bool showBestsellers(int count) const;
 
     BookData getBookByISBN(const ISBNIndex& isbn);
     BookData getBookByISBNStr(const std::string& isbnStr);
     //查询
-    std::vector<BookData> searchByISBN(const std::string& isbnStr);
-    std::vector<BookData> searchByName(const std::string& name);
-    std::vector<BookData> searchByAuthor(const std::string& author);
-    std::vector<BookData> searchByKeyword(const std::string& keyword);
+    ArenaVector<BookData> searchByISBN(const std::string& isbnStr);
+    ArenaVector<BookData> searchByName(const std::string& name);
+    ArenaVector<BookData> searchByAuthor(const std::string& author);
+    ArenaVector<BookData> searchByKeyword(const std::string& keyword);
     std::vector<BookData> getAllBooks();
 
     // 创建新书
@@ -365,27 +338,34 @@ public:
         return financeSystem.getFinanceSummary(count);
     }
 
+    bool showFinanceRange(long long from, long long to, long long span = 0) const {
+        return financeSystem.showFinanceRange(from, to, span);
+    }
+
     int getFinanceRecordCount() const {
         return financeSystem.getRecordCount();
     }
 
+    // 事务回滚后，重新载入缓存在内存中的统计
+    void reloadAfterRollback() {
+        financeSystem.updateTransactionCount();
+        updateNextBookId();
+        queryCache.invalidateAll();
+    }
+
+    // 事务提交后，之前缓存的查询结果都已过时
+    void invalidateQueryCache() {
+        queryCache.invalidateAll();
+    }
+
     static std::string formatDouble(double value) {
         return FinanceSystem::formatDouble(value);
     }
 
     bool isValidSingleKeywordStr(const std::string& keyword) const;
 
-    std::vector<std::pair<double, double>> getAllFinanceRecords() {
-        std::vector<std::pair<double, double>> result;
-
-        // 获取所有 FinanceRecord 对象
-        std::vector<FinanceRecord> records = financeSystem.getAllFinanceRecords();
-
-        for (const auto& record : records) {
-            result.emplace_back(record.income, record.expense);
-        }
-
-        return result;
+    const FinanceSystem& getFinanceSystem() const {
+        return financeSystem;
     }
 
 };
@@ -8,11 +8,18 @@
 #include <map>
 #include <iomanip>
 #include <sstream>
+#include <shared_mutex>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
 #include "account.h"
 #include "book.h"
 #include "parser.h"
 #include "token.h"
 #include "log.h"
+#include "mvcc.h"
+#include "transaction.h"
 
 
 class Bookstore {
@@ -23,13 +30,32 @@ private:
     std::string selectedISBN;
     LogSystem logSystem;
 
-    std::vector<std::string> tokenize(const std::string& input);
-    bool parseShowCommand(const std::vector<std::string>& tokens,
+    // 指令闩：只读指令共享持有，修改数据的指令独占持有
+    std::shared_mutex commandLatch;
+
+    // 事务：同一时刻至多一个会话有未提交的事务。其他会话要加指令闩时等它提交或回滚（transactionEnded）
+    LoginStack* transactionOwner = nullptr;
+    std::mutex transactionMutex;
+    std::condition_variable transactionEnded;
+    std::atomic<unsigned> transactionWaiters{0};
+    std::function<void()> waitHook;
+    bool transactionsStopped = false;   // 服务器正在关闭：不再开始事务，也不再等
+    // 事务内 modify -ISBN 的 (原 ISBN, 新 ISBN)。各会话的选中随改名立即更新，回滚时倒序改回
+    std::vector<std::pair<std::string, std::string>> transactionRenames;
+
+    Tokens tokenize(const std::string& input);
+    bool parseShowCommand(const Tokens& tokens,
                          std::string& type, std::string& value);
-    bool parseModifyCommand(const std::vector<std::string>& tokens,
+    bool parseModifyCommand(const Tokens& tokens,
                            std::vector<std::pair<std::string, std::string>>& modifications);
 
-    bool checkCommandPrivilege(const std::vector<std::string>& tokens, int& requiredPrivilege);
+    bool checkCommandPrivilege(const Tokens& tokens, int& requiredPrivilege);
+    static bool isSnapshotCommand(const Tokens& tokens);
+    static bool isReadOnlyCommand(const Tokens& tokens);
+    bool otherTransactionOpen(LoginStack* session);
+    template<typename Lock>
+    void lockOutsideTransaction(LoginStack* session, Lock& lock);
+    void rollbackTransaction();
 
 public:
     Bookstore();
@@ -37,12 +63,29 @@ public:
 
     void run();
 
-    bool processCommand(const std::vector<std::string>& tokens);
+    // 执行一行指令；遇到 quit/exit 返回 false
+    bool executeLine(const std::string& line);
+
+    // 服务器模式下每个连接是一个会话
+    void openSession(LoginStack* stack);
+    void closeSession(LoginStack* stack);
+    void switchSession(LoginStack* stack);
+
+    // 有会话开始等其他会话的事务时调用 hook（服务器据此加开工作线程，免得事务的主人等不到线程）
+    void setWaitHook(std::function<void()> hook);
+    // 回滚未提交的事务并不再接受 begin，等着的会话都放行。服务器关闭时调用
+    void stopTransactions();
+    // 正在等其他会话事务结束的线程数
+    unsigned transactionWaiterCount() const { return transactionWaiters; }
+
+    bool processCommand(const Tokens& tokens);
 
-    bool handleAccountCommand(const std::vector<std::string>& tokens);
-    bool handleBookCommand(const std::vector<std::string>& tokens);
-    bool handleFinanceCommand(const std::vector<std::string>& tokens);
-    bool handleLogCommand(const std::vector<std::string>& tokens);
+    bool handleAccountCommand(const Tokens& tokens);
+    bool handleBookCommand(const Tokens& tokens);
+    bool handleFinanceCommand(const Tokens& tokens);
+    bool handleFinanceRangeCommand(const Tokens& tokens);
+    bool handleLogCommand(const Tokens& tokens);
+    bool handleTransactionCommand(const Tokens& tokens);
     bool isValidQuantityStr(const std::string& quantityStr);
     bool isValidTotalCostStr(const std::string& costStr);
 
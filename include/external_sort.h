@@ -0,0 +1,130 @@
+#ifndef BOOKSTORE_2025_EXTERNAL_SORT_H
+#define BOOKSTORE_2025_EXTERNAL_SORT_H
+
+#include <cstdio>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <type_traits>
+
+// 定内存外部归并排序
+// add 把记录攒进内存缓冲，缓冲达到预算就排序后写成一个顺段（匿名临时文件）；
+// finish 把各顺段多路归并后按序交给 visit。顺段过多时先分批归并成更长的顺段，
+// 使同时打开的顺段数有上限。全部记录放得进预算时不落盘。
+template<class T, class Less>
+class ExternalSorter {
+    static_assert(std::is_trivially_copyable<T>::value, "顺段按字节读写，记录须可平凡复制");
+
+private:
+    static constexpr size_t MAX_FAN_IN = 64;    // 一次归并最多同时读的顺段数
+
+    Less less;
+    size_t capacity;                // 内存缓冲最多容纳的记录数
+    std::vector<T> buffer;
+    std::vector<FILE*> runs;
+    bool failed = false;
+
+    // 把缓冲排序后整段写成一个顺段
+    void spill() {
+        if (buffer.empty()) return;
+        std::sort(buffer.begin(), buffer.end(), less);
+        FILE* run = std::tmpfile();
+        if (run && std::fwrite(buffer.data(), sizeof(T), buffer.size(), run) == buffer.size()) {
+            std::rewind(run);
+            runs.push_back(run);
+        } else {
+            if (run) std::fclose(run);
+            failed = true;
+        }
+        buffer.clear();
+    }
+
+    // 多路归并 [first, last) 范围内的顺段，归并后关闭它们
+    template<class Visitor>
+    void merge(size_t first, size_t last, Visitor visit) {
+        struct Head {
+            T record;
+            size_t run;
+        };
+        auto greater = [this](const Head& a, const Head& b) { return less(b.record, a.record); };
+        std::priority_queue<Head, std::vector<Head>, decltype(greater)> heads(greater);
+
+        for (size_t i = first; i < last; i++) {
+            Head head{T(), i};
+            if (std::fread(&head.record, sizeof(T), 1, runs[i]) == 1) heads.push(head);
+        }
+
+        while (!heads.empty()) {
+            Head head = heads.top();
+            heads.pop();
+            visit(head.record);
+            if (std::fread(&head.record, sizeof(T), 1, runs[head.run]) == 1) heads.push(head);
+        }
+
+        for (size_t i = first; i < last; i++) {
+            std::fclose(runs[i]);
+            runs[i] = nullptr;
+        }
+    }
+
+public:
+    ExternalSorter(size_t budgetBytes, Less lessThan = Less())
+        : less(lessThan), capacity(std::max<size_t>(1, budgetBytes / sizeof(T))) {}
+
+    ~ExternalSorter() {
+        for (FILE* run : runs) {
+            if (run) std::fclose(run);
+        }
+    }
+
+    ExternalSorter(const ExternalSorter&) = delete;
+    ExternalSorter& operator=(const ExternalSorter&) = delete;
+
+    void add(const T& record) {
+        buffer.push_back(record);
+        if (buffer.size() >= capacity) spill();
+    }
+
+    // 按序访问全部记录；写临时文件失败时返回 false
+    template<class Visitor>
+    bool finish(Visitor visit) {
+        if (runs.empty() && !failed) {
+            std::sort(buffer.begin(), buffer.end(), less);
+            for (const T& record : buffer) visit(record);
+            buffer.clear();
+            return true;
+        }
+
+        spill();
+        std::vector<T>().swap(buffer);
+
+        // 顺段太多时先把每 MAX_FAN_IN 段归并成一段
+        while (!failed && runs.size() > MAX_FAN_IN) {
+            std::vector<FILE*> merged;
+            for (size_t first = 0; first < runs.size(); first += MAX_FAN_IN) {
+                const size_t last = std::min(runs.size(), first + MAX_FAN_IN);
+                FILE* out = std::tmpfile();
+                if (!out) {
+                    failed = true;
+                    break;
+                }
+                merge(first, last, [&](const T& record) {
+                    if (std::fwrite(&record, sizeof(T), 1, out) != 1) failed = true;
+                });
+                std::rewind(out);
+                merged.push_back(out);
+            }
+            for (FILE* run : runs) {
+                if (run) std::fclose(run);
+            }
+            runs.swap(merged);
+        }
+        if (failed) return false;
+
+        merge(0, runs.size(), visit);
+        runs.clear();
+        return true;
+    }
+};
+
+#endif //BOOKSTORE_2025_EXTERNAL_SORT_H
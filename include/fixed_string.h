@@ -0,0 +1,109 @@
+#ifndef BOOKSTORE_2025_FIXED_STRING_H
+#define BOOKSTORE_2025_FIXED_STRING_H
+
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <ostream>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// 定长字符串键：N 字节存储（含结尾 '\0'），末尾一律补零
+// 补零后按整段字节做无符号字典序比较即与 strcmp 等价，于是比较不必找 '\0'：
+// 按 16 字节一组用 SSE2 找第一个不同的字节（x86-64 都有，不需要额外的编译选项），
+// 余下部分按 8 字节大端整数比较。键最长几十字节，32 字节一组的 AVX2 省不了几次比较，不单独做。
+// 存储大小与原先的 char[N] 相同，已有数据文件无需迁移。
+template<size_t N>
+class FixedString {
+    static_assert(N >= 2, "至少要能存一个字符");
+
+private:
+    char data[N] = {0};
+
+    static int compareBytes(const unsigned char* a, const unsigned char* b) {
+        size_t i = 0;
+#if defined(__SSE2__)
+        for (; i + 16 <= N; i += 16) {
+            const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            const __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+            const unsigned mask = ~static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y))) & 0xFFFFu;
+            if (mask != 0) {
+                const size_t k = i + __builtin_ctz(mask);
+                return static_cast<int>(a[k]) - static_cast<int>(b[k]);
+            }
+        }
+#endif
+        for (; i + 8 <= N; i += 8) {
+            uint64_t x, y;
+            memcpy(&x, a + i, 8);
+            memcpy(&y, b + i, 8);
+            if (x != y) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+                x = __builtin_bswap64(x);
+                y = __builtin_bswap64(y);
+#endif
+                return x < y ? -1 : 1;
+            }
+        }
+        for (; i < N; i++) {
+            if (a[i] != b[i]) return static_cast<int>(a[i]) - static_cast<int>(b[i]);
+        }
+        return 0;
+    }
+
+    void assign(const char* str, size_t len) {
+        if (len > N - 1) len = N - 1;
+        memcpy(data, str, len);
+        memset(data + len, 0, N - len);
+    }
+
+public:
+    static constexpr size_t capacity = N - 1;   // 最多存放的字符数
+
+    FixedString() = default;
+
+    FixedString(const std::string& str) {
+        assign(str.data(), strnlen(str.c_str(), N - 1));
+    }
+
+    FixedString(const char* str) {
+        if (str) assign(str, strnlen(str, N - 1));
+    }
+
+    int compare(const FixedString& other) const {
+        return compareBytes(reinterpret_cast<const unsigned char*>(data),
+                            reinterpret_cast<const unsigned char*>(other.data));
+    }
+
+    bool operator<(const FixedString& other) const { return compare(other) < 0; }
+    bool operator>(const FixedString& other) const { return compare(other) > 0; }
+    bool operator<=(const FixedString& other) const { return compare(other) <= 0; }
+    bool operator>=(const FixedString& other) const { return compare(other) >= 0; }
+    bool operator==(const FixedString& other) const { return memcmp(data, other.data, N) == 0; }
+    bool operator!=(const FixedString& other) const { return memcmp(data, other.data, N) != 0; }
+
+    // 前 8 字节按大端拼成的整数，与字符串同序；Map 块内查找先比它
+    uint64_t prefix() const {
+        unsigned char bytes[8] = {0};
+        memcpy(bytes, data, N < 8 ? N : 8);
+        uint64_t value;
+        memcpy(&value, bytes, 8);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        value = __builtin_bswap64(value);
+#endif
+        return value;
+    }
+
+    const char* c_str() const { return data; }
+    std::string toString() const { return std::string(data, strnlen(data, N)); }
+    size_t size() const { return strnlen(data, N); }
+    bool empty() const { return data[0] == '\0'; }
+
+    friend std::ostream& operator<<(std::ostream& os, const FixedString& str) {
+        os << str.data;
+        return os;
+    }
+};
+
+#endif //BOOKSTORE_2025_FIXED_STRING_H
@@ -0,0 +1,339 @@
+#ifndef BOOKSTORE_2025_FRONT_CODING_H
+#define BOOKSTORE_2025_FRONT_CODING_H
+
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+// 前缀压缩（front coding）的 Map 块，键须为 FixedString
+// 条目依次存放：[与前一个键共享的前缀长 1B][后缀长 1B][后缀][值]。
+// 条目分组，每组的第一个条目（重启点）存完整的键。查找先在重启点上二分，再在组内顺序解码；
+// 插入、删除只重新编码所在的一组，再把块内其后的字节整体挪动。
+// 组长超过 2 * RESTART_INTERVAL 时从中间拆成两组，所以一次插入至多让块增长
+// MAX_INSERT_GROWTH 字节；删除不会让块变大：被删键之后那个键多出来的后缀
+// 不会超过被删键自己的后缀。
+template<typename KeyType, typename ValueType, size_t BlockBytes>
+struct FrontCodedBlock {
+    static constexpr int KEY_LEN = KeyType::capacity;
+    static_assert(KEY_LEN < 256, "前缀长与后缀长各占一个字节");
+
+    static constexpr int RESTART_INTERVAL = 16;
+    static constexpr int MAX_GROUP = 2 * RESTART_INTERVAL;
+    static constexpr int VALUE_LEN = sizeof(ValueType);
+    static constexpr int MAX_ENTRY = 2 + KEY_LEN + VALUE_LEN;
+    static constexpr int MAX_INSERT_GROWTH = MAX_ENTRY + KEY_LEN;
+    static constexpr int HEADER = 2 * sizeof(KeyType) + 4 * sizeof(int);
+    static constexpr int MAX_RESTARTS =
+        static_cast<int>(BlockBytes - HEADER) / ((2 + VALUE_LEN) * RESTART_INTERVAL) + 2;
+    static constexpr int PAYLOAD = static_cast<int>(BlockBytes - HEADER) - MAX_RESTARTS * sizeof(int);
+    static_assert(PAYLOAD >= 8 * MAX_ENTRY, "块太小");
+
+    KeyType min_index;
+    KeyType max_index;
+    int count;
+    int next;
+    int used;           // payload 已用字节数
+    int restartCount;
+    int restarts[MAX_RESTARTS];     // 各组在 payload 中的起始偏移
+    char payload[PAYLOAD];          // used 之后的字节不初始化
+
+    FrontCodedBlock() : count(0), next(-1), used(0), restartCount(0) {
+        min_index = KeyType();
+        max_index = KeyType();
+    }
+
+    // 把借来的页当作空块使用
+    void reset() {
+        count = 0;
+        next = -1;
+        used = 0;
+        restartCount = 0;
+        min_index = KeyType();
+        max_index = KeyType();
+    }
+
+    // 再插入一个条目可能放不下，须先分裂
+    bool full() const {
+        return PAYLOAD - used < MAX_INSERT_GROWTH || restartCount + 2 > MAX_RESTARTS;
+    }
+
+    // 批量装载时块已装到九成
+    bool loadFull() const {
+        return used >= PAYLOAD - PAYLOAD / 10 || PAYLOAD - used < MAX_ENTRY || restartCount + 2 > MAX_RESTARTS;
+    }
+
+    void updateMinMax() {}  // 各修改操作自行维护
+
+    // 按序访问全部条目，visitor 返回 false 时停止并返回 false
+    template<typename Visitor>
+    bool visit(Visitor visitor) const {
+        Cursor cursor(*this, 0);
+        for (int i = 0; i < count; i++) {
+            ValueType value;
+            cursor.next(value);
+            if (!visitor(KeyType(cursor.key), value)) return false;
+        }
+        return true;
+    }
+
+    // 批量装载时在末尾追加（调用者保证有序且 !loadFull()）
+    void append(const KeyType &key, const ValueType &value) {
+        const bool restart = count % RESTART_INTERVAL == 0;
+        if (restart) restarts[restartCount++] = used;
+        used += encodeEntry(payload + used, restart ? 0 : sharedPrefix(max_index.c_str(), key.c_str()),
+                            key, value);
+        if (count == 0) min_index = key;
+        max_index = key;
+        count++;
+    }
+
+    bool insert(const KeyType &key, const ValueType &value) {
+        const Entry target{key, value};
+        // 第一个条目不小于 target 的组之前那一组；target 比所有重启点都小时放进第 0 组
+        const int group = restartCount == 0 ? -1 : std::max(0, firstRestartNotLess(target) - 1);
+
+        Entry entries[MAX_GROUP + 1];
+        const int n = group < 0 ? 0 : decodeGroup(group, entries);
+        int pos = 0;
+        while (pos < n && entries[pos].lessThan(target)) pos++;
+        if (pos < n && entries[pos].equals(target)) return false;
+
+        std::copy_backward(entries + pos, entries + n, entries + n + 1);
+        entries[pos] = target;
+
+        // 组太长时从中间拆开
+        if (n + 1 > MAX_GROUP) {
+            const int half = (n + 1) / 2;
+            replaceGroup(group, entries, half, entries + half, n + 1 - half);
+        } else {
+            replaceGroup(group, entries, n + 1, nullptr, 0);
+        }
+        count++;
+        refreshMinMax();
+        return true;
+    }
+
+    bool remove(const KeyType &key, const ValueType &value) {
+        const Entry target{key, value};
+        // 最后一个重启点不大于 target 的组
+        const int group = firstRestartGreater(target) - 1;
+        if (group < 0) return false;
+
+        Entry entries[MAX_GROUP + 1];
+        const int n = decodeGroup(group, entries);
+        int pos = 0;
+        while (pos < n && entries[pos].lessThan(target)) pos++;
+        if (pos == n || !entries[pos].equals(target)) return false;
+
+        std::copy(entries + pos + 1, entries + n, entries + pos);
+        replaceGroup(group, entries, n - 1, nullptr, 0);
+        count--;
+        refreshMinMax();
+        return true;
+    }
+
+    template<typename Values>
+    void getAllValues(const KeyType &index, Values &result) const {
+        if (count == 0 || index < min_index || index > max_index) return;
+
+        // 从最后一个完整键小于 index 的重启点开始：等于 index 的条目可能从它的组里开始
+        int left = 0, right = restartCount;
+        while (left < right) {
+            const int mid = (left + right) / 2;
+            const int offset = restarts[mid];
+            const int length = static_cast<unsigned char>(payload[offset + 1]);
+            if (compareKey(payload + offset + 2, length, index.c_str()) < 0) left = mid + 1;
+            else right = mid;
+        }
+        const int start = left > 0 ? restarts[left - 1] : 0;
+
+        Cursor cursor(*this, start);
+        while (cursor.offset < used) {
+            ValueType value;
+            cursor.next(value);
+            const int cmp = strcmp(cursor.key, index.c_str());
+            if (cmp > 0) break;
+            if (cmp == 0) result.push_back(value);
+        }
+    }
+
+    // 把后一半条目移到 right，两半都按固定间隔重新分组
+    void splitInto(FrontCodedBlock &right) {
+        std::vector<Entry> entries;
+        entries.reserve(count);
+        visit([&](const KeyType &key, const ValueType &value) {
+            entries.push_back(Entry{key, value});
+            return true;
+        });
+
+        const int mid = count / 2;
+        right.rebuild(entries.data() + mid, count - mid);
+        rebuild(entries.data(), mid);
+    }
+
+private:
+    struct Entry {
+        KeyType key;
+        ValueType value;
+
+        bool lessThan(const Entry &other) const {
+            return key < other.key || (key == other.key && value < other.value);
+        }
+
+        bool equals(const Entry &other) const {
+            return key == other.key && value == other.value;
+        }
+    };
+
+    // 从 payload 的某个重启点开始顺序解码
+    struct Cursor {
+        const FrontCodedBlock &block;
+        int offset;
+        char key[KEY_LEN + 1] = {};
+
+        Cursor(const FrontCodedBlock &b, const int start) : block(b), offset(start) {}
+
+        void next(ValueType &value) {
+            const int shared = static_cast<unsigned char>(block.payload[offset]);
+            const int suffix = static_cast<unsigned char>(block.payload[offset + 1]);
+            memcpy(key + shared, block.payload + offset + 2, suffix);
+            key[shared + suffix] = '\0';
+            memcpy(reinterpret_cast<char *>(&value), block.payload + offset + 2 + suffix, VALUE_LEN);
+            offset += 2 + suffix + VALUE_LEN;
+        }
+    };
+
+    static int sharedPrefix(const char *a, const char *b) {
+        int n = 0;
+        while (n < KEY_LEN && a[n] != '\0' && a[n] == b[n]) n++;
+        return n;
+    }
+
+    // 未以 '\0' 结尾的 [key, key + length) 与 target 比较
+    static int compareKey(const char *key, const int length, const char *target) {
+        const int cmp = strncmp(key, target, length);
+        if (cmp != 0) return cmp;
+        return target[length] == '\0' ? 0 : -1;
+    }
+
+    static int encodeEntry(char *out, const int shared, const KeyType &key, const ValueType &value) {
+        const int suffix = static_cast<int>(key.size()) - shared;
+        out[0] = static_cast<char>(shared);
+        out[1] = static_cast<char>(suffix);
+        memcpy(out + 2, key.c_str() + shared, suffix);
+        memcpy(out + 2 + suffix, reinterpret_cast<const char *>(&value), VALUE_LEN);
+        return 2 + suffix + VALUE_LEN;
+    }
+
+    // 一组条目编码到 out，第一个存完整的键；返回字节数
+    static int encodeGroup(char *out, const Entry *entries, const int n) {
+        int length = 0;
+        for (int i = 0; i < n; i++) {
+            const int shared = i == 0 ? 0 : sharedPrefix(entries[i - 1].key.c_str(), entries[i].key.c_str());
+            length += encodeEntry(out + length, shared, entries[i].key, entries[i].value);
+        }
+        return length;
+    }
+
+    int groupEnd(const int group) const {
+        return group + 1 < restartCount ? restarts[group + 1] : used;
+    }
+
+    int decodeGroup(const int group, Entry *entries) const {
+        Cursor cursor(*this, restarts[group]);
+        const int end = groupEnd(group);
+        int n = 0;
+        while (cursor.offset < end) {
+            cursor.next(entries[n].value);
+            entries[n].key = KeyType(cursor.key);
+            n++;
+        }
+        return n;
+    }
+
+    Entry restartEntry(const int group) const {
+        Cursor cursor(*this, restarts[group]);
+        Entry entry;
+        cursor.next(entry.value);
+        entry.key = KeyType(cursor.key);
+        return entry;
+    }
+
+    int firstRestartNotLess(const Entry &target) const {
+        int left = 0, right = restartCount;
+        while (left < right) {
+            const int mid = (left + right) / 2;
+            if (restartEntry(mid).lessThan(target)) left = mid + 1;
+            else right = mid;
+        }
+        return left;
+    }
+
+    int firstRestartGreater(const Entry &target) const {
+        int left = 0, right = restartCount;
+        while (left < right) {
+            const int mid = (left + right) / 2;
+            if (!target.lessThan(restartEntry(mid))) left = mid + 1;
+            else right = mid;
+        }
+        return left;
+    }
+
+    // 用至多两组新条目替换第 group 组（group 为 -1 表示块原本为空），并挪动其后的字节
+    void replaceGroup(int group, const Entry *first, const int firstCount,
+                      const Entry *second, const int secondCount) {
+        char buffer[(MAX_GROUP + 1) * MAX_ENTRY];
+        const int firstLength = encodeGroup(buffer, first, firstCount);
+        const int secondLength = encodeGroup(buffer + firstLength, second, secondCount);
+        const int newGroups = (firstCount > 0) + (secondCount > 0);
+
+        int start = 0, end = 0;
+        if (group < 0) {
+            group = 0;
+        } else {
+            start = restarts[group];
+            end = groupEnd(group);
+        }
+        const int delta = firstLength + secondLength - (end - start);
+        const int oldGroups = restartCount == 0 ? 0 : 1;
+
+        memmove(payload + end + delta, payload + end, used - end);
+        memcpy(payload + start, buffer, firstLength + secondLength);
+        used += delta;
+
+        // 重启点：其后各组整体平移 delta，组数变化时挪动数组
+        const int tail = restartCount - (group + oldGroups);
+        memmove(restarts + group + newGroups, restarts + group + oldGroups, tail * sizeof(int));
+        restartCount = group + newGroups + tail;
+        for (int r = group + newGroups; r < restartCount; r++) restarts[r] += delta;
+        if (firstCount > 0) restarts[group] = start;
+        if (secondCount > 0) restarts[group + (firstCount > 0)] = start + firstLength;
+    }
+
+    void refreshMinMax() {
+        if (count == 0) {
+            min_index = KeyType();
+            max_index = KeyType();
+            return;
+        }
+        min_index = restartEntry(0).key;
+        Cursor cursor(*this, restarts[restartCount - 1]);
+        ValueType value;
+        while (cursor.offset < used) cursor.next(value);
+        max_index = KeyType(cursor.key);
+    }
+
+    // 按固定间隔分组，把 entries[0, n) 编码为本块的全部内容
+    void rebuild(const Entry *entries, const int n) {
+        used = 0;
+        restartCount = 0;
+        count = 0;
+        for (int i = 0; i < n; i++) append(entries[i].key, entries[i].value);
+        if (n == 0) {
+            min_index = KeyType();
+            max_index = KeyType();
+        }
+    }
+};
+
+#endif //BOOKSTORE_2025_FRONT_CODING_H
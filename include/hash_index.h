@@ -0,0 +1,356 @@
+#ifndef BOOKSTORE_2025_HASH_INDEX_H
+#define BOOKSTORE_2025_HASH_INDEX_H
+
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <mutex>
+#include <shared_mutex>
+#include <cstdint>
+#include "MemoryRiver.h"
+#include "key_hash.h"
+#include "arena.h"
+#include "page_pool.h"
+
+// 可扩展哈希索引：键 -> 键所在的 Map 块地址
+// 目录（2^globalDepth 个桶地址）常驻内存，查一个键只读一个桶，再由 Map 读一个数据块。
+// 桶满时分裂，局部深度已等于全局深度时目录先翻倍。删除不合并桶。
+// 只记块地址而不记值：值照旧只存在 Map 的块里，块内插删也不必动索引，只有条目换块
+// （分裂、批量装载）时才要改。要求键在表中唯一。
+//
+// 文件：fname.hash 存桶，fname.hashdir 存目录页。两者都是 MemoryRiver，随事务缓冲、提交、回滚。
+// 桶文件的 info 记录是否正常关闭及关闭时数据文件的大小与修改时间，对不上时由 Map 按链表重建
+template<typename KeyType>
+class HashIndex {
+private:
+    static constexpr size_t BUCKET_BYTES = 4 << 10;
+    static constexpr int BUCKET_CAPACITY =
+            static_cast<int>((BUCKET_BYTES - 2 * sizeof(int)) / (sizeof(KeyType) + sizeof(int)));
+    static constexpr int DIR_PAGE_SLOTS = 1024;
+    static constexpr int MAX_DEPTH = 24;
+
+    struct Bucket {
+        int localDepth;
+        int count;
+        RawArray<KeyType, BUCKET_CAPACITY> keys;
+        RawArray<int, BUCKET_CAPACITY> blocks;
+
+        // 自己写构造函数：Bucket() 值初始化时也不会先把整个桶清零
+        Bucket() : localDepth(0), count(0) {}
+
+        // 把借来的页当作空桶使用
+        void reset(const int depth) {
+            localDepth = depth;
+            count = 0;
+        }
+
+        int indexOf(const KeyType &key) const {
+            for (int i = 0; i < count; i++) {
+                if (keys[i] == key) return i;
+            }
+            return -1;
+        }
+    };
+
+    struct DirPage {
+        int slots[DIR_PAGE_SLOTS];
+    };
+
+    // 桶文件 info：1 正常关闭标记，2 数据文件大小，3、4 数据文件修改时间的高低 32 位
+    static constexpr int BUCKET_INFO = 4;
+    // 目录文件 info：1 全局深度
+    static constexpr int DIR_INFO = 1;
+
+    MemoryRiver<Bucket, BUCKET_INFO> bucketFile;
+    MemoryRiver<DirPage, DIR_INFO> dirFile;
+    std::string bucketName;
+    std::string dirName;
+    int globalDepth = 0;
+    std::vector<int> directory;
+    mutable std::shared_mutex latch;
+    mutable PagePool<Bucket> pages;
+
+    static uint64_t hashOf(const KeyType &key) {
+        return hashBytes(&key, sizeof(KeyType));
+    }
+
+    int slotOf(const uint64_t hash) const {
+        return static_cast<int>(hash & ((1ULL << globalDepth) - 1));
+    }
+
+    static int pageAddr(const int page) {
+        return static_cast<int>(DIR_INFO * sizeof(int) + page * sizeof(DirPage));
+    }
+
+    int pageCount() const {
+        return std::max(1, static_cast<int>(directory.size()) / DIR_PAGE_SLOTS);
+    }
+
+    // 把内存中的目录写回目录文件，新增的页追加在末尾
+    void saveDirectory(const int oldPages) {
+        DirPage page;
+        for (int p = 0; p < pageCount(); p++) {
+            std::fill(page.slots, page.slots + DIR_PAGE_SLOTS, -1);
+            const int begin = p * DIR_PAGE_SLOTS;
+            const int end = std::min<int>(begin + DIR_PAGE_SLOTS, static_cast<int>(directory.size()));
+            std::copy(directory.begin() + begin, directory.begin() + end, page.slots);
+            if (p < oldPages) {
+                dirFile.update(page, pageAddr(p));
+            } else {
+                dirFile.write(page);
+            }
+        }
+        dirFile.write_info(globalDepth, 1);
+    }
+
+    void loadDirectory() {
+        dirFile.get_info(globalDepth, 1);
+        directory.assign(static_cast<size_t>(1) << globalDepth, -1);
+        DirPage page;
+        for (int p = 0; p < pageCount(); p++) {
+            dirFile.read(page, pageAddr(p));
+            const int begin = p * DIR_PAGE_SLOTS;
+            const int end = std::min<int>(begin + DIR_PAGE_SLOTS, static_cast<int>(directory.size()));
+            std::copy(page.slots, page.slots + (end - begin), directory.begin() + begin);
+        }
+    }
+
+    void initialise() {
+        bucketFile.initialise(bucketName);
+        dirFile.initialise(dirName);
+        Bucket bucket;
+        globalDepth = 0;
+        directory.assign(1, bucketFile.write(bucket));
+        saveDirectory(0);
+    }
+
+    // 分裂 slot 所指的桶；局部深度已等于全局深度时先把目录翻倍。调用者需独占 latch
+    bool split(const int slot) {
+        const int addr = directory[slot];
+        Bucket bucket;
+        bucketFile.read(bucket, addr);
+        if (bucket.localDepth >= MAX_DEPTH) return false;
+
+        const int oldPages = pageCount();
+        if (bucket.localDepth == globalDepth) {
+            const size_t size = directory.size();
+            directory.resize(size * 2);
+            std::copy(directory.begin(), directory.begin() + size, directory.begin() + size);
+            globalDepth++;
+        }
+
+        // 按第 localDepth 位把条目分到两个桶
+        const uint64_t bit = 1ULL << bucket.localDepth;
+        Bucket high;
+        high.localDepth = bucket.localDepth + 1;
+        int kept = 0;
+        for (int i = 0; i < bucket.count; i++) {
+            if (hashOf(bucket.keys[i]) & bit) {
+                high.keys[high.count] = bucket.keys[i];
+                high.blocks[high.count++] = bucket.blocks[i];
+            } else {
+                bucket.keys[kept] = bucket.keys[i];
+                bucket.blocks[kept++] = bucket.blocks[i];
+            }
+        }
+        bucket.count = kept;
+        bucket.localDepth++;
+
+        const int highAddr = bucketFile.write(high);
+        bucketFile.update(bucket, addr);
+        for (size_t s = 0; s < directory.size(); s++) {
+            if (directory[s] == addr && (s & bit)) directory[s] = highAddr;
+        }
+        saveDirectory(oldPages);
+        return true;
+    }
+
+public:
+    explicit HashIndex(const std::string &fname)
+        : bucketFile(fname + ".hash"), dirFile(fname + ".hashdir"),
+          bucketName(fname + ".hash"), dirName(fname + ".hashdir") {}
+
+    HashIndex(const HashIndex &) = delete;
+    HashIndex &operator=(const HashIndex &) = delete;
+
+    // 打开索引。上次没有正常关闭、数据文件之后被改过或索引文件缺失时清空索引并返回 false，
+    // 由调用者按数据重建。打开后即清掉正常关闭标记，中途崩溃的话下次打开会重建
+    bool open(const std::string &dataFile) {
+        std::unique_lock<std::shared_mutex> lock(latch);
+        bool valid = std::ifstream(bucketName).good() && std::ifstream(dirName).good();
+        if (valid) {
+            int clean = 0, size = 0, high = 0, low = 0;
+            bucketFile.get_info(clean, 1);
+            bucketFile.get_info(size, 2);
+            bucketFile.get_info(high, 3);
+            bucketFile.get_info(low, 4);
+            int64_t dataSize, dataMtime;
+            valid = clean == 1 && fileStamp(dataFile, dataSize, dataMtime) && size == dataSize &&
+                    high == static_cast<int>(dataMtime >> 32) && low == static_cast<int>(dataMtime);
+        }
+        if (valid) {
+            loadDirectory();
+        } else {
+            initialise();
+        }
+        const int dirty = 0;
+        bucketFile.write_info(dirty, 1);
+        return valid;
+    }
+
+    // 正常关闭：记下数据文件此刻的大小与修改时间
+    void close(const std::string &dataFile) {
+        std::unique_lock<std::shared_mutex> lock(latch);
+        int64_t dataSize, dataMtime;
+        if (!fileStamp(dataFile, dataSize, dataMtime)) return;
+        const int size = static_cast<int>(dataSize);
+        const int high = static_cast<int>(dataMtime >> 32);
+        const int low = static_cast<int>(dataMtime);
+        const int clean = 1;
+        bucketFile.write_info(size, 2);
+        bucketFile.write_info(high, 3);
+        bucketFile.write_info(low, 4);
+        bucketFile.write_info(clean, 1);
+    }
+
+    // 按 (键, 块地址) 整体重建：先按条目数定好全局深度（有桶装不下就加深），条目按桶号排好后
+    // 借一个桶页逐桶填好顺序追加写出，不逐个插入（逐个插入每个键都要读写一次桶）。
+    // 旧桶不再被引用，不截断文件，可以在事务中进行
+    void rebuild(const std::vector<std::pair<KeyType, int>> &entries) {
+        std::unique_lock<std::shared_mutex> lock(latch);
+        int depth = 0;
+        while (depth < MAX_DEPTH && (entries.size() << 2) > (static_cast<size_t>(BUCKET_CAPACITY) * 3 << depth)) {
+            depth++;
+        }
+
+        std::vector<uint64_t> hashes;
+        hashes.reserve(entries.size());
+        for (const auto &entry : entries) hashes.push_back(hashOf(entry.first));
+        std::vector<int> counts;
+        while (true) {
+            counts.assign(static_cast<size_t>(1) << depth, 0);
+            bool overflow = false;
+            for (const uint64_t hash : hashes) {
+                if (++counts[hash & ((1ULL << depth) - 1)] > BUCKET_CAPACITY) {
+                    overflow = true;
+                    break;
+                }
+            }
+            if (!overflow || depth == MAX_DEPTH) break;
+            depth++;
+        }
+
+        const uint64_t mask = (1ULL << depth) - 1;
+        std::vector<size_t> order(entries.size());
+        for (size_t i = 0; i < order.size(); i++) order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&](const size_t a, const size_t b) {
+            return (hashes[a] & mask) < (hashes[b] & mask);
+        });
+
+        const int oldPages = pageCount();
+        globalDepth = depth;
+        directory.resize(counts.size());
+        auto page = pages.acquire();
+        Bucket &bucket = *page;
+        size_t next = 0;
+        for (size_t slot = 0; slot < directory.size(); slot++) {
+            bucket.reset(depth);
+            for (; next < order.size() && (hashes[order[next]] & mask) == slot; next++) {
+                if (bucket.count == BUCKET_CAPACITY) continue;  // 深度已到上限仍装不下（实际不会发生）
+                bucket.keys[bucket.count] = entries[order[next]].first;
+                bucket.blocks[bucket.count++] = entries[order[next]].second;
+            }
+            directory[slot] = bucketFile.write(bucket);
+        }
+        saveDirectory(oldPages);
+        const int dirty = 0;
+        bucketFile.write_info(dirty, 1);
+    }
+
+    bool find(const KeyType &key, int &block) const {
+        std::shared_lock<std::shared_mutex> lock(latch);
+        auto page = pages.acquire();
+        const Bucket &bucket = *page;
+        bucketFile.read(*page, directory[slotOf(hashOf(key))]);
+        const int i = bucket.indexOf(key);
+        if (i < 0) return false;
+        block = bucket.blocks[i];
+        return true;
+    }
+
+    // 批量查找：blocks[i] 为 keys[i] 所在的块，不在索引中为 -1。涉及的桶一次读齐
+    template<typename Keys, typename Blocks>
+    void find(const Keys &keys, Blocks &blocks) const {
+        std::shared_lock<std::shared_mutex> lock(latch);
+        ArenaVector<int> addrs;
+        addrs.reserve(keys.size());
+        for (const KeyType &key : keys) addrs.push_back(directory[slotOf(hashOf(key))]);
+        ArenaVector<int> distinct(addrs);
+        std::sort(distinct.begin(), distinct.end());
+        distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+
+        // 一次要的桶可能比页池留的空闲页多，从指令区域取；桶的构造不清零槽位
+        ArenaVector<Bucket> buckets(distinct.size());
+        ArenaVector<Bucket *> targets;
+        targets.reserve(buckets.size());
+        for (Bucket &bucket : buckets) targets.push_back(&bucket);
+        bucketFile.read(targets.data(), distinct.data(), static_cast<int>(distinct.size()));
+
+        blocks.assign(keys.size(), -1);
+        for (size_t k = 0; k < keys.size(); k++) {
+            const size_t b = std::lower_bound(distinct.begin(), distinct.end(), addrs[k]) - distinct.begin();
+            const int i = buckets[b].indexOf(keys[k]);
+            if (i >= 0) blocks[k] = buckets[b].blocks[i];
+        }
+    }
+
+    // 记下 key 在 block 块中（已有则改地址）
+    void put(const KeyType &key, const int block) {
+        std::unique_lock<std::shared_mutex> lock(latch);
+        const uint64_t hash = hashOf(key);
+        while (true) {
+            const int slot = slotOf(hash);
+            Bucket bucket;
+            bucketFile.read(bucket, directory[slot]);
+            int i = bucket.indexOf(key);
+            if (i >= 0 && bucket.blocks[i] == block) return;
+            if (i < 0 && bucket.count < BUCKET_CAPACITY) i = bucket.count++;
+            if (i >= 0) {
+                bucket.keys[i] = key;
+                bucket.blocks[i] = block;
+                bucketFile.update(bucket, directory[slot]);
+                return;
+            }
+            if (!split(slot)) return;
+        }
+    }
+
+    // 删掉 key，仅当它记的仍是 block 块（同一个键先插新值、后删旧值时，新值可能已在别的块）
+    void erase(const KeyType &key, const int block) {
+        std::unique_lock<std::shared_mutex> lock(latch);
+        const int addr = directory[slotOf(hashOf(key))];
+        Bucket bucket;
+        bucketFile.read(bucket, addr);
+        const int i = bucket.indexOf(key);
+        if (i < 0 || bucket.blocks[i] != block) return;
+        bucket.count--;
+        bucket.keys[i] = bucket.keys[bucket.count];
+        bucket.blocks[i] = bucket.blocks[bucket.count];
+        bucketFile.update(bucket, addr);
+    }
+
+    void flushBuffered() {
+        bucketFile.flushBuffered();
+        dirFile.flushBuffered();
+    }
+
+    // 回滚后目录回到文件中的内容
+    void discardBuffered() {
+        std::unique_lock<std::shared_mutex> lock(latch);
+        bucketFile.discardBuffered();
+        dirFile.discardBuffered();
+        loadDirectory();
+    }
+};
+
+#endif //BOOKSTORE_2025_HASH_INDEX_H
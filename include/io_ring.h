@@ -0,0 +1,202 @@
+#ifndef BOOKSTORE_2025_IO_RING_H
+#define BOOKSTORE_2025_IO_RING_H
+
+#include <vector>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// 异步读写模式（./code --io-uring）：一批地址事先已知的块读写（多键查找、事务提交、快照写回）
+// 经 io_uring 一次提交，多个请求同时在途，不再一个 pread 等完再发下一个。
+// 直接走 io_uring_setup/io_uring_enter 系统调用，不依赖 liburing。
+// 每个线程一个环；内核不支持或被禁用时退回逐个 pread/pwrite，结果相同
+inline bool asyncIo = false;
+
+class IoRing {
+public:
+    struct Request {
+        int fd;
+        bool write;
+        void *buf;
+        size_t len;
+        long long offset;
+    };
+
+    // 执行一批读写，全部完成后返回；有请求出错或没能写完整时返回 false。
+    // 读到文件末尾就停，之外的部分与 pread 一样不填，不算失败
+    template<typename Requests>
+    static bool run(Requests &requests) {
+        if (asyncIo && requests.size() > 1) {
+            IoRing &ring = local();
+            if (ring.ready()) return ring.submitAll(requests);
+        }
+        bool ok = true;
+        for (const Request &request : requests) ok &= finish(request, 0);
+        return ok;
+    }
+
+private:
+    static constexpr unsigned ENTRIES = 64;
+
+    int ringFd = -1;
+    void *sqMap = nullptr;
+    void *cqMap = nullptr;
+    size_t sqMapSize = 0;
+    size_t cqMapSize = 0;
+    io_uring_sqe *sqes = nullptr;
+    size_t sqesSize = 0;
+
+    unsigned *sqTail = nullptr;
+    unsigned *sqMask = nullptr;
+    unsigned *sqArray = nullptr;
+    unsigned sqEntries = 0;
+    unsigned *cqHead = nullptr;
+    unsigned *cqTail = nullptr;
+    unsigned *cqMask = nullptr;
+    io_uring_cqe *cqes = nullptr;
+
+    static IoRing &local() {
+        thread_local IoRing ring;
+        return ring;
+    }
+
+    // 同步完成 request 中 done 字节之后的部分。读到文件末尾（pread 返回 0）即算读完
+    static bool finish(const Request &request, size_t done) {
+        char *p = static_cast<char *>(request.buf);
+        while (done < request.len) {
+            const ssize_t n = request.write ?
+                              ::pwrite(request.fd, p + done, request.len - done, request.offset + done) :
+                              ::pread(request.fd, p + done, request.len - done, request.offset + done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n == 0 && !request.write) return true;
+            if (n <= 0) return false;
+            done += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    // 映射环的一段，失败时返回空
+    void *mapRing(const size_t size, const off_t offset) const {
+        void *p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, offset);
+        return p == MAP_FAILED ? nullptr : p;
+    }
+
+    IoRing() {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        ringFd = static_cast<int>(::syscall(__NR_io_uring_setup, ENTRIES, &params));
+        if (ringFd < 0) return;
+
+        sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) sqMapSize = cqMapSize = std::max(sqMapSize, cqMapSize);
+
+        // 每段映射成功就记进成员，中途失败时 release() 按成员把已映射的几段都解除
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqMap = mapRing(sqMapSize, IORING_OFF_SQ_RING);
+        if (sqMap) cqMap = single ? sqMap : mapRing(cqMapSize, IORING_OFF_CQ_RING);
+        if (cqMap) sqes = static_cast<io_uring_sqe *>(mapRing(sqesSize, IORING_OFF_SQES));
+        if (!sqes) {
+            release();
+            return;
+        }
+
+        char *sq = static_cast<char *>(sqMap);
+        sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        sqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        sqEntries = params.sq_entries;
+        char *cq = static_cast<char *>(cqMap);
+        cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        cqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    }
+
+    ~IoRing() { release(); }
+
+    IoRing(const IoRing &) = delete;
+    IoRing &operator=(const IoRing &) = delete;
+
+    // 解除已映射的各段并关闭环，可以在构造的任何一步失败后调用，也可以重复调用
+    void release() {
+        if (sqes) ::munmap(sqes, sqesSize);
+        if (cqMap && cqMap != sqMap) ::munmap(cqMap, cqMapSize);
+        if (sqMap) ::munmap(sqMap, sqMapSize);
+        if (ringFd >= 0) ::close(ringFd);
+        sqes = nullptr;
+        sqMap = cqMap = nullptr;
+        sqMapSize = cqMapSize = sqesSize = 0;
+        sqTail = sqMask = sqArray = nullptr;
+        cqHead = cqTail = cqMask = nullptr;
+        cqes = nullptr;
+        sqEntries = 0;
+        ringFd = -1;
+    }
+
+    bool ready() const { return sqes != nullptr; }
+
+    // 环里放不下时分几轮：每收回一个完成就补进一个新请求，始终保持环满
+    template<typename Requests>
+    bool submitAll(Requests &requests) {
+        bool ok = true;
+        size_t next = 0;        // 下一个待放入环的请求
+        size_t queued = 0;      // 已放入环、尚未提交给内核
+        size_t inFlight = 0;    // 已提交、尚未收回完成
+        while (next < requests.size() || inFlight > 0) {
+            unsigned tail = *sqTail;
+            while (next < requests.size() && inFlight + queued < sqEntries) {
+                const Request &request = requests[next];
+                const unsigned slot = tail & *sqMask;
+                io_uring_sqe &sqe = sqes[slot];
+                memset(&sqe, 0, sizeof(sqe));
+                sqe.opcode = request.write ? IORING_OP_WRITE : IORING_OP_READ;
+                sqe.fd = request.fd;
+                sqe.addr = reinterpret_cast<uint64_t>(request.buf);
+                sqe.len = static_cast<uint32_t>(request.len);
+                sqe.off = static_cast<uint64_t>(request.offset);
+                sqe.user_data = next;
+                sqArray[slot] = slot;
+                tail++;
+                next++;
+                queued++;
+            }
+            __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+
+            const long submitted = ::syscall(__NR_io_uring_enter, ringFd, static_cast<unsigned>(queued), 1U,
+                                             IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (submitted < 0) {
+                if (errno == EINTR) continue;
+                // 环出了问题：还没完成的请求全部同步重做（重复读写同样的内容不影响结果）
+                ok = true;
+                for (const Request &request : requests) ok &= finish(request, 0);
+                release();
+                return ok;
+            }
+            queued -= static_cast<size_t>(submitted);
+            inFlight += static_cast<size_t>(submitted);
+
+            unsigned head = *cqHead;
+            const unsigned cqTailNow = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+            for (; head != cqTailNow; head++) {
+                const io_uring_cqe &cqe = cqes[head & *cqMask];
+                const Request &request = requests[cqe.user_data];
+                // 出错或只读写了一部分时同步补完剩下的部分；读到文件末尾时 finish 立即返回成功
+                if (cqe.res < 0 || static_cast<size_t>(cqe.res) < request.len) {
+                    ok &= finish(request, cqe.res < 0 ? 0 : static_cast<size_t>(cqe.res));
+                }
+                inFlight--;
+            }
+            __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        }
+        return ok;
+    }
+};
+
+#endif //BOOKSTORE_2025_IO_RING_H
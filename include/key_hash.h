@@ -0,0 +1,31 @@
+#ifndef BOOKSTORE_2025_KEY_HASH_H
+#define BOOKSTORE_2025_KEY_HASH_H
+
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+// 键的 64 位哈希，按字节计算：键须为 FixedString、整数这类相等即字节相同的类型
+inline uint64_t mixHash(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+inline uint64_t hashBytes(const void* data, size_t len) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    uint64_t h = 0x9E3779B97F4A7C15ULL ^ len;
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        h = mixHash(h ^ word);
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, p, len);
+    return mixHash(h ^ tail);
+}
+
+#endif //BOOKSTORE_2025_KEY_HASH_H
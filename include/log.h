@@ -3,10 +3,14 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <ctime>
 #include <iomanip>
 #include <sstream>
+#include <fstream>
+#include <memory>
+#include <mutex>
 #include "account.h"
 
 struct OperationLog {
@@ -24,14 +28,18 @@ struct OperationLog {
         timestamp = timeStr;
     }
 
-    std::string toString() const {
-        std::ostringstream oss;
-        oss << "[" << timestamp << "] "
+    void writeTo(std::ostream& out) const {
+        out << "[" << timestamp << "] "
             << "用户: " << std::setw(15) << std::left << userID
             << " | 命令: " << std::setw(20) << std::left << command;
         if (!details.empty()) {
-            oss << " | 详情: " << details;
+            out << " | 详情: " << details;
         }
+    }
+
+    std::string toString() const {
+        std::ostringstream oss;
+        writeTo(oss);
         return oss.str();
     }
 };
@@ -56,16 +64,71 @@ struct EmployeeRecord {
     }
 };
 
+// 定长块输出缓冲：报表按 CHUNK_SIZE 字节分块写到目标流，内存占用与记录数无关
+class ChunkedStreamBuf : public std::streambuf {
+private:
+    static constexpr size_t CHUNK_SIZE = 4096;
+    std::ostream& target;
+    char buffer[CHUNK_SIZE];
+
+    bool flushChunk() {
+        const std::streamsize n = pptr() - pbase();
+        if (n > 0) {
+            target.write(pbase(), n);
+            target.flush();
+            pbump(static_cast<int>(-n));
+        }
+        return target.good();
+    }
+
+protected:
+    int_type overflow(int_type ch) override {
+        if (!flushChunk()) return traits_type::eof();
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    int sync() override {
+        return flushChunk() ? 0 : -1;
+    }
+
+public:
+    explicit ChunkedStreamBuf(std::ostream& os) : target(os) {
+        setp(buffer, buffer + CHUNK_SIZE);
+    }
+
+    ~ChunkedStreamBuf() override {
+        flushChunk();
+    }
+};
+
 class LogSystem {
 private:
-    std::vector<OperationLog> operationLogs;
+    // 操作日志分段存放：写满 LOG_SEGMENT 条的段不再改动，由 shared_ptr 共享。
+    // 报表在锁内只取各段的指针（见 snapshotLogs），锁外逐条输出，输出再慢也不挡住其他会话记日志
+    static constexpr size_t LOG_SEGMENT = 1024;
+    using LogSegment = std::vector<OperationLog>;
+    using LogSnapshot = std::vector<std::shared_ptr<const LogSegment>>;
+
+    LogSnapshot sealedLogs;
+    LogSegment openLogs;    // 未写满的末段
     std::vector<EmployeeRecord> employeeRecords;
     std::string logFileName;
+    std::ofstream logFile;      // 首次记日志时以追加方式打开，之后一直开着
 
     AccountSystem* accountSystem;
 
+    // 多个会话线程会同时写日志、生成报表；锁内不做格式化和输出
+    mutable std::recursive_mutex logMutex;
+
     void updateEmployeeRecord(const std::string& userID, const std::string& username, int privilege);
 
+    // 取当前全部日志：写满的段直接共享，末段复制一份
+    LogSnapshot snapshotLogs() const;
+
 public:
     LogSystem();
 
@@ -73,8 +136,9 @@ public:
         accountSystem = accSystem;
     }
 
-    void logOperation(const std::string& userID, const std::string& command,
-                     const std::string& details = "");
+    // 指令与详情在这里才复制进日志
+    void logOperation(const std::string& userID, std::string_view command,
+                     std::string_view details = {});
 
     std::vector<OperationLog> getAllLogs() const;
 
@@ -82,11 +146,13 @@ public:
 
     std::vector<EmployeeRecord> getEmployeeRecords() const;
 
-    std::string generateFinanceReport(const std::vector<std::pair<double, double>>& financeData) const;
+    // 从旧到新流式输出财务报表
+    void streamFinanceReport(std::ostream& os, const FinanceSystem& finance) const;
 
     std::string generateEmployeeReport() ;
 
-    std::string generateFullLogReport() const;
+    // 从新到旧流式输出完整日志
+    void streamFullLogReport(std::ostream& os) const;
 
     void collectEmployeeRecordsFromLogs();
 
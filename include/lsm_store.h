@@ -0,0 +1,726 @@
+#ifndef BOOKSTORE_2025_LSM_STORE_H
+#define BOOKSTORE_2025_LSM_STORE_H
+
+#include <iostream>
+#include <map>
+#include <set>
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "mvcc.h"
+#include "transaction.h"
+
+// LSM 存储：给键单调递增、只追加的表用（财务记录）。Map 每插一条都要走到链表尾块并重写整块，
+// 这里插入只写内存表，并把条目顺序追加到预写日志 fname.wal。
+// 内存表攒满 MEMTABLE_LIMIT 条后按序整体写成一个不可变的有序段（run）放进第 0 层，清空日志。
+// 后台线程分层合并：第 0 层攒到 L0_LIMIT 段时与第 1 层合并成新的第 1 层；第 i 层（i >= 1）
+// 只有一个段，条目数超过 L1_LIMIT * 10^(i-1) 时并入下一层。合并只读不可变的段，
+// 顺序写出新段后在清单中替换旧段。
+//
+// 文件：fname.lsm 清单（各层的段号），fname.<段号>.run 段，fname.wal 日志。
+// 清单先写临时文件再改名替换。段写完才进清单，崩溃留下的清单外的段在下次打开时删除；
+// 日志里已经落进段的条目重放后与段中相同的条目合并掉。
+//
+// 与 Map 一样是 (键, 值) 的多重映射，相同的 (键, 值) 只保留一份；不支持删除。
+// 事务内的插入先放在待提交表里，提交时才进内存表和日志。
+// 内存表中的条目记着插入时的写版本，快照读者看不到快照之后插入的条目。有活跃快照时内存表照常落盘，
+// 落盘条目的写版本留在 recentVersions 里，快照读者在段中跳过比自己新的条目；
+// 所有快照都看得到某条目后（pruneVersions）才把它的版本丢掉。条目只追加，同一 (键, 值) 不会在
+// 不同版本各落盘一次，按条目记版本即可
+template<typename KeyType, typename ValueType>
+class LsmStore : public TransactionalStore, public VersionedStore {
+private:
+    struct Entry {
+        KeyType key;
+        ValueType value;
+    };
+
+    // (键, 值) 升序；也可以只拿键与条目比较，用于在内存表中按键查找
+    struct EntryLess {
+        using is_transparent = void;
+
+        bool operator()(const Entry &a, const Entry &b) const {
+            if (a.key < b.key) return true;
+            if (b.key < a.key) return false;
+            return a.value < b.value;
+        }
+
+        bool operator()(const Entry &a, const KeyType &key) const { return a.key < key; }
+        bool operator()(const KeyType &key, const Entry &b) const { return key < b.key; }
+    };
+
+    static bool sameEntry(const Entry &a, const Entry &b) {
+        return !EntryLess()(a, b) && !EntryLess()(b, a);
+    }
+
+    static constexpr size_t MEMTABLE_LIMIT = 4096;
+    static constexpr size_t L0_LIMIT = 4;
+    static constexpr size_t L1_LIMIT = MEMTABLE_LIMIT * 16;
+    static constexpr size_t PAGE_ENTRIES = std::max<size_t>(1, (4 << 10) / sizeof(Entry));
+    static constexpr size_t SCAN_PAGES = 16;        // 顺序扫描时一次读入的页数
+    static constexpr uint32_t MAGIC = 0x4C534D31;   // "LSM1"
+    static constexpr int ORPHAN_PROBE = 8;
+
+    // 段文件：文件头、按 (键, 值) 升序的定长条目，末尾是每页（PAGE_ENTRIES 条）的首键
+    struct RunHeader {
+        uint32_t magic;
+        uint32_t entrySize;
+        uint64_t count;
+        KeyType maxKey;
+    };
+
+    struct Run {
+        int seq = -1;
+        int fd = -1;
+        uint64_t count = 0;
+        KeyType maxKey;
+        std::vector<KeyType> fences;
+
+        Run() = default;
+        Run(const Run &) = delete;
+        Run &operator=(const Run &) = delete;
+
+        ~Run() {
+            if (fd >= 0) ::close(fd);
+        }
+
+        bool mayContain(const KeyType &low, const KeyType &high) const {
+            return count > 0 && !(high < fences.front()) && !(maxKey < low);
+        }
+
+        // 第一个可能含有 >= key 的条目的页
+        size_t firstPage(const KeyType &key) const {
+            const size_t p = std::lower_bound(fences.begin(), fences.end(), key) - fences.begin();
+            return p == 0 ? 0 : p - 1;
+        }
+
+        // 从第 first 条起读入至多 n 条
+        size_t read(std::vector<Entry> &out, const uint64_t first, const size_t n) const {
+            const size_t want = static_cast<size_t>(std::min<uint64_t>(n, count - first));
+            out.resize(want);
+            const ssize_t got = ::pread(fd, out.data(), want * sizeof(Entry),
+                                        sizeof(RunHeader) + first * sizeof(Entry));
+            out.resize(got > 0 ? static_cast<size_t>(got) / sizeof(Entry) : 0);
+            return out.size();
+        }
+    };
+
+    // 按 (键, 值) 升序顺序写出一个段，相邻的相同条目只写一份
+    class RunWriter {
+    private:
+        int fd;
+        uint64_t count = 0;
+        std::vector<Entry> batch;
+        std::vector<KeyType> fences;
+        bool hasLast = false;
+        Entry last;
+        bool ok;
+
+        void flushBatch() {
+            if (batch.empty() || !ok) return;
+            const size_t bytes = batch.size() * sizeof(Entry);
+            const off_t offset = sizeof(RunHeader) + (count - batch.size()) * sizeof(Entry);
+            ok = ::pwrite(fd, batch.data(), bytes, offset) == static_cast<ssize_t>(bytes);
+            batch.clear();
+        }
+
+    public:
+        explicit RunWriter(const std::string &path)
+            : fd(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)), ok(fd >= 0) {
+            batch.reserve(PAGE_ENTRIES * SCAN_PAGES);
+        }
+
+        ~RunWriter() {
+            if (fd >= 0) ::close(fd);
+        }
+
+        void add(const Entry &entry) {
+            if (hasLast && sameEntry(last, entry)) return;
+            if (count % PAGE_ENTRIES == 0) fences.push_back(entry.key);
+            batch.push_back(entry);
+            count++;
+            last = entry;
+            hasLast = true;
+            if (batch.size() == batch.capacity()) flushBatch();
+        }
+
+        bool finish() {
+            flushBatch();
+            if (!ok) return false;
+            const size_t bytes = fences.size() * sizeof(KeyType);
+            RunHeader header{MAGIC, static_cast<uint32_t>(sizeof(Entry)), count, hasLast ? last.key : KeyType()};
+            return ::pwrite(fd, fences.data(), bytes, sizeof(RunHeader) + count * sizeof(Entry)) ==
+                           static_cast<ssize_t>(bytes) &&
+                   ::pwrite(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header));
+        }
+    };
+
+    // 段上的顺序游标，一次读入 SCAN_PAGES 页
+    class RunCursor {
+    private:
+        std::shared_ptr<Run> run;
+        std::vector<Entry> buffer;
+        uint64_t next;      // buffer 之后的第一条
+        size_t pos = 0;
+
+    public:
+        RunCursor(std::shared_ptr<Run> r, const KeyType *low) : run(std::move(r)) {
+            next = low ? run->firstPage(*low) * PAGE_ENTRIES : 0;
+            fill();
+            if (low) {
+                while (valid() && get().key < *low) advance();
+            }
+        }
+
+        bool valid() const { return pos < buffer.size(); }
+        const Entry &get() const { return buffer[pos]; }
+
+        void fill() {
+            pos = 0;
+            if (next >= run->count) {
+                buffer.clear();
+                return;
+            }
+            next += run->read(buffer, next, PAGE_ENTRIES * SCAN_PAGES);
+        }
+
+        void advance() {
+            if (++pos == buffer.size()) fill();
+        }
+    };
+
+    std::string filename;
+    // 保护内存表、待提交表、各层的段和清单
+    mutable std::shared_mutex latch;
+    std::map<Entry, long long, EntryLess> memtable;     // 条目 -> 插入时的写版本
+    std::set<Entry, EntryLess> pending;
+    std::vector<std::vector<std::shared_ptr<Run>>> levels;
+    // 已落盘、但还有活跃快照看不到的条目 -> 写版本。用单独的锁，快照结束时回收不必等 latch
+    std::map<Entry, long long, EntryLess> recentVersions;
+    mutable std::mutex versionMutex;
+    int nextSeq = 0;
+    int walFd = -1;
+
+    std::thread compactor;
+    std::mutex compactMutex;
+    std::condition_variable compactWake;
+    bool compactWanted = false;
+    std::atomic<bool> stopping{false};
+
+    std::string manifestFile() const { return filename + ".lsm"; }
+    std::string walFile() const { return filename + ".wal"; }
+    std::string runFile(const int seq) const { return filename + "." + std::to_string(seq) + ".run"; }
+
+    std::shared_ptr<Run> openRun(const int seq) const {
+        std::shared_ptr<Run> run(new Run());
+        run->seq = seq;
+        run->fd = ::open(runFile(seq).c_str(), O_RDONLY | O_CLOEXEC);
+        RunHeader header;
+        if (run->fd < 0 || ::pread(run->fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) ||
+            header.magic != MAGIC || header.entrySize != sizeof(Entry)) {
+            return nullptr;
+        }
+        run->count = header.count;
+        run->maxKey = header.maxKey;
+        run->fences.resize((header.count + PAGE_ENTRIES - 1) / PAGE_ENTRIES);
+        const size_t bytes = run->fences.size() * sizeof(KeyType);
+        if (::pread(run->fd, run->fences.data(), bytes, sizeof(RunHeader) + header.count * sizeof(Entry)) !=
+            static_cast<ssize_t>(bytes)) {
+            return nullptr;
+        }
+        return run;
+    }
+
+    // 清单：MAGIC、下一个段号、层数，然后每层的段数与段号
+    // 调用者需独占 latch（或在构造中）
+    bool saveManifest() const {
+        const std::string tmp = manifestFile() + ".tmp";
+        FILE *out = std::fopen(tmp.c_str(), "wb");
+        if (!out) return false;
+        std::vector<int> words{static_cast<int>(MAGIC), nextSeq, static_cast<int>(levels.size())};
+        for (const auto &level : levels) {
+            words.push_back(static_cast<int>(level.size()));
+            for (const auto &run : level) words.push_back(run->seq);
+        }
+        const bool ok = std::fwrite(words.data(), sizeof(int), words.size(), out) == words.size();
+        if (std::fclose(out) != 0 || !ok) {
+            std::remove(tmp.c_str());
+            return false;
+        }
+        return std::rename(tmp.c_str(), manifestFile().c_str()) == 0;
+    }
+
+    void loadManifest() {
+        FILE *in = std::fopen(manifestFile().c_str(), "rb");
+        if (!in) return;
+        int header[3] = {0, 0, 0};
+        bool ok = std::fread(header, sizeof(int), 3, in) == 3 && header[0] == static_cast<int>(MAGIC);
+        if (ok) {
+            nextSeq = header[1];
+            levels.assign(header[2], {});
+            for (auto &level : levels) {
+                int runs = 0;
+                ok = ok && std::fread(&runs, sizeof(int), 1, in) == 1;
+                for (int i = 0; ok && i < runs; i++) {
+                    int seq = 0;
+                    ok = std::fread(&seq, sizeof(int), 1, in) == 1;
+                    std::shared_ptr<Run> run = ok ? openRun(seq) : nullptr;
+                    ok = ok && run;
+                    if (ok) level.push_back(run);
+                }
+            }
+        }
+        std::fclose(in);
+        if (!ok) {
+            std::cerr << filename << ": broken LSM manifest\n";
+            std::exit(1);
+        }
+    }
+
+    // 重放日志进内存表，末尾写了一半的条目截掉
+    void replayWal() {
+        walFd = ::open(walFile().c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (walFd < 0) return;
+        struct stat st;
+        if (::fstat(walFd, &st) != 0) return;
+        const size_t whole = static_cast<size_t>(st.st_size) / sizeof(Entry);
+        std::vector<Entry> entries(whole);
+        if (whole > 0 && ::pread(walFd, entries.data(), whole * sizeof(Entry), 0) ==
+                                 static_cast<ssize_t>(whole * sizeof(Entry))) {
+            for (const Entry &entry : entries) memtable.emplace(entry, 0);
+        }
+        if (static_cast<size_t>(st.st_size) != whole * sizeof(Entry)) {
+            if (::ftruncate(walFd, whole * sizeof(Entry)) != 0) return;
+        }
+        ::lseek(walFd, 0, SEEK_END);
+    }
+
+    void appendWal(const std::vector<Entry> &entries) {
+        if (walFd < 0 || entries.empty()) return;
+        const size_t bytes = entries.size() * sizeof(Entry);
+        if (::write(walFd, entries.data(), bytes) != static_cast<ssize_t>(bytes)) {
+            std::cerr << filename << ": write-ahead log append failed\n";
+        }
+    }
+
+    // 内存表写成第 0 层的一个段并清空日志。调用者需独占 latch
+    void flushMemtable() {
+        if (memtable.empty()) return;
+        const int seq = nextSeq++;
+        RunWriter writer(runFile(seq));
+        for (const auto &item : memtable) writer.add(item.first);
+        std::shared_ptr<Run> run = writer.finish() ? openRun(seq) : nullptr;
+        if (!run) {
+            std::remove(runFile(seq).c_str());
+            return;
+        }
+        if (levels.empty()) levels.emplace_back();
+        levels[0].push_back(run);
+        if (!saveManifest()) {
+            levels[0].pop_back();
+            std::remove(runFile(seq).c_str());
+            return;
+        }
+        // 快照看不到的条目记下版本；开始写时没有活跃快照，则之后也不会有更早的快照
+        if (currentNewestSnapshot >= 0) {
+            std::lock_guard<std::mutex> guard(versionMutex);
+            for (const auto &item : memtable) {
+                if (item.second > currentNewestSnapshot) recentVersions.emplace(item.first, item.second);
+            }
+        }
+        memtable.clear();
+        if (walFd >= 0 && ::ftruncate(walFd, 0) == 0) ::lseek(walFd, 0, SEEK_SET);
+        requestCompaction();
+    }
+
+    // 已提交的条目进内存表与日志；内存表满时落盘。调用者需独占 latch
+    void applyCommitted(const std::vector<Entry> &entries) {
+        std::vector<Entry> fresh;
+        for (const Entry &entry : entries) {
+            if (memtable.emplace(entry, currentWriteVersion).second) fresh.push_back(entry);
+        }
+        appendWal(fresh);
+        if (memtable.size() >= MEMTABLE_LIMIT) flushMemtable();
+    }
+
+    static size_t levelLimit(const size_t level) {
+        size_t limit = L1_LIMIT;
+        for (size_t i = 1; i < level; i++) limit *= 10;
+        return limit;
+    }
+
+    void requestCompaction() {
+        {
+            std::lock_guard<std::mutex> lock(compactMutex);
+            compactWanted = true;
+        }
+        compactWake.notify_one();
+    }
+
+    // 选出一次合并：输入段与目标层。没有要做的返回 false
+    bool pickCompaction(std::vector<std::shared_ptr<Run>> &inputs, size_t &target) const {
+        std::shared_lock<std::shared_mutex> lock(latch);
+        for (size_t level = 0; level < levels.size(); level++) {
+            size_t entries = 0;
+            for (const auto &run : levels[level]) entries += run->count;
+            const bool over = level == 0 ? levels[0].size() >= L0_LIMIT : entries > levelLimit(level);
+            if (!over) continue;
+            inputs = levels[level];
+            target = level + 1;
+            if (target < levels.size()) {
+                inputs.insert(inputs.end(), levels[target].begin(), levels[target].end());
+            }
+            return true;
+        }
+        return false;
+    }
+
+    // 做一次合并，返回是否做了
+    bool compactOnce() {
+        std::vector<std::shared_ptr<Run>> inputs;
+        size_t target = 0;
+        if (!pickCompaction(inputs, target)) return false;
+
+        int seq;
+        {
+            std::unique_lock<std::shared_mutex> lock(latch);
+            seq = nextSeq++;
+        }
+        RunWriter writer(runFile(seq));
+        std::vector<RunCursor> cursors;
+        for (const auto &run : inputs) cursors.emplace_back(run, nullptr);
+        mergeCursors(cursors, nullptr, [&](const Entry &entry) {
+            writer.add(entry);
+            return !stopping;
+        });
+        std::shared_ptr<Run> output = !stopping && writer.finish() ? openRun(seq) : nullptr;
+        if (!output) {
+            std::remove(runFile(seq).c_str());
+            return false;
+        }
+
+        {
+            std::unique_lock<std::shared_mutex> lock(latch);
+            if (levels.size() <= target) levels.resize(target + 1);
+            for (auto &level : levels) {
+                level.erase(std::remove_if(level.begin(), level.end(), [&](const std::shared_ptr<Run> &run) {
+                    return std::find(inputs.begin(), inputs.end(), run) != inputs.end();
+                }), level.end());
+            }
+            levels[target].push_back(output);
+            if (!saveManifest()) {
+                std::cerr << filename << ": failed to save LSM manifest\n";
+                std::exit(1);
+            }
+        }
+        // 打开着的段仍可被正在扫描的读者读完
+        for (const auto &run : inputs) std::remove(runFile(run->seq).c_str());
+        return true;
+    }
+
+    void compactLoop() {
+        std::unique_lock<std::mutex> lock(compactMutex);
+        while (!stopping) {
+            compactWake.wait(lock, [&] { return stopping || compactWanted; });
+            compactWanted = false;
+            lock.unlock();
+            while (!stopping && compactOnce()) {}
+            lock.lock();
+        }
+    }
+
+    // 按 (键, 值) 升序归并内存部分与各段游标，去掉相同条目；键超过 high 或 emit 返回 false 时结束
+    template<typename Emit>
+    static void mergeCursors(std::vector<RunCursor> &cursors, const KeyType *high, Emit emit,
+                             const std::vector<Entry> &memory = {}) {
+        size_t memPos = 0;
+        bool hasLast = false;
+        Entry last;
+        while (true) {
+            const Entry *best = memPos < memory.size() ? &memory[memPos] : nullptr;
+            int from = -1;
+            for (size_t i = 0; i < cursors.size(); i++) {
+                if (cursors[i].valid() && (!best || EntryLess()(cursors[i].get(), *best))) {
+                    best = &cursors[i].get();
+                    from = static_cast<int>(i);
+                }
+            }
+            if (!best || (high && *high < best->key)) return;
+            const Entry entry = *best;
+            if (from < 0) {
+                memPos++;
+            } else {
+                cursors[from].advance();
+            }
+            if (hasLast && sameEntry(last, entry)) continue;
+            if (!emit(entry)) return;
+            last = entry;
+            hasLast = true;
+        }
+    }
+
+    // 内存表中对当前线程可见的条目
+    bool visible(const long long version) const {
+        return currentSnapshot < 0 || version <= currentSnapshot;
+    }
+
+    // 段中 [low, high] 内对当前快照不可见的条目（有序）。不在快照中时为空
+    std::vector<Entry> hiddenEntries(const KeyType *low, const KeyType *high) const {
+        std::vector<Entry> hidden;
+        if (currentSnapshot < 0) return hidden;
+        std::lock_guard<std::mutex> guard(versionMutex);
+        auto begin = low ? recentVersions.lower_bound(*low) : recentVersions.begin();
+        auto end = high ? recentVersions.upper_bound(*high) : recentVersions.end();
+        for (auto it = begin; it != end; ++it) {
+            if (!visible(it->second)) hidden.push_back(it->first);
+        }
+        return hidden;
+    }
+
+    // 取下 [low, high] 内的内存条目（有序）、全部段与段中不可见的条目，之后不再持闩
+    void snapshotSources(const KeyType *low, const KeyType *high, std::vector<Entry> &memory,
+                         std::vector<std::shared_ptr<Run>> &runs, std::vector<Entry> &hidden) const {
+        std::shared_lock<std::shared_mutex> lock(latch);
+        hidden = hiddenEntries(low, high);
+        auto begin = low ? memtable.lower_bound(*low) : memtable.begin();
+        auto end = high ? memtable.upper_bound(*high) : memtable.end();
+        for (auto it = begin; it != end; ++it) {
+            if (visible(it->second)) memory.push_back(it->first);
+        }
+        if (currentTransaction && !pending.empty()) {
+            auto pendingBegin = low ? pending.lower_bound(*low) : pending.begin();
+            auto pendingEnd = high ? pending.upper_bound(*high) : pending.end();
+            const size_t mid = memory.size();
+            memory.insert(memory.end(), pendingBegin, pendingEnd);
+            std::inplace_merge(memory.begin(), memory.begin() + mid, memory.end(), EntryLess());
+        }
+        for (const auto &level : levels) {
+            for (const auto &run : level) {
+                if (!low || !high || run->mayContain(*low, *high)) runs.push_back(run);
+            }
+        }
+    }
+
+    template<typename Visitor>
+    void scan(const KeyType *low, const KeyType *high, Visitor visit) const {
+        std::vector<Entry> memory;
+        std::vector<std::shared_ptr<Run>> runs;
+        std::vector<Entry> hidden;
+        snapshotSources(low, high, memory, runs, hidden);
+        std::vector<RunCursor> cursors;
+        for (const auto &run : runs) cursors.emplace_back(run, low);
+        if (hidden.empty()) {
+            mergeCursors(cursors, high, visit, memory);
+            return;
+        }
+        // 归并结果与 hidden 同序，顺着跳过不可见的条目
+        size_t skip = 0;
+        mergeCursors(cursors, high, [&](const Entry &entry) {
+            while (skip < hidden.size() && EntryLess()(hidden[skip], entry)) skip++;
+            if (skip < hidden.size() && sameEntry(hidden[skip], entry)) return true;
+            return visit(entry);
+        }, memory);
+    }
+
+public:
+    explicit LsmStore(const std::string &fname) : filename(fname) {
+        loadManifest();
+        for (int seq = nextSeq; seq < nextSeq + ORPHAN_PROBE; seq++) std::remove(runFile(seq).c_str());
+        replayWal();
+        TransactionManager::registerStore(this);
+        VersionClock::registerStore(this);
+        compactor = std::thread([this] { compactLoop(); });
+        requestCompaction();
+    }
+
+    ~LsmStore() override {
+        TransactionManager::unregisterStore(this);
+        VersionClock::unregisterStore(this);
+        {
+            std::lock_guard<std::mutex> lock(compactMutex);
+            stopping = true;
+        }
+        compactWake.notify_one();
+        compactor.join();
+        std::unique_lock<std::shared_mutex> lock(latch);
+        flushMemtable();
+        if (walFd >= 0) ::close(walFd);
+    }
+
+    LsmStore(const LsmStore &) = delete;
+    LsmStore &operator=(const LsmStore &) = delete;
+
+    // 是否还没有任何条目（不计事务中未提交的）
+    bool empty() const {
+        std::shared_lock<std::shared_mutex> lock(latch);
+        if (!memtable.empty()) return false;
+        for (const auto &level : levels) {
+            if (!level.empty()) return false;
+        }
+        return true;
+    }
+
+    void insert(const KeyType &key, const ValueType &value) {
+        const Entry entry{key, value};
+        std::unique_lock<std::shared_mutex> lock(latch);
+        if (currentTransaction) {
+            pending.insert(entry);
+            return;
+        }
+        applyCommitted({entry});
+    }
+
+    // 批量装载：entries 须按 (键, 值) 升序排好，直接写成第 0 层的一个段。
+    // 段或清单写不成功时不留下任何改动，返回 false
+    bool bulkLoad(const std::vector<std::pair<KeyType, ValueType>> &entries) {
+        if (entries.empty()) return true;
+        std::unique_lock<std::shared_mutex> lock(latch);
+        const int seq = nextSeq++;
+        RunWriter writer(runFile(seq));
+        for (const auto &item : entries) writer.add(Entry{item.first, item.second});
+        std::shared_ptr<Run> run = writer.finish() ? openRun(seq) : nullptr;
+        if (!run) {
+            std::remove(runFile(seq).c_str());
+            return false;
+        }
+        if (levels.empty()) levels.emplace_back();
+        levels[0].push_back(run);
+        if (!saveManifest()) {
+            levels[0].pop_back();
+            std::remove(runFile(seq).c_str());
+            return false;
+        }
+        requestCompaction();
+        return true;
+    }
+
+    void commitBuffered() override {
+        std::unique_lock<std::shared_mutex> lock(latch);
+        if (pending.empty()) return;
+        std::vector<Entry> entries(pending.begin(), pending.end());
+        pending.clear();
+        applyCommitted(entries);
+    }
+
+    void discardBuffered() override {
+        std::unique_lock<std::shared_mutex> lock(latch);
+        pending.clear();
+    }
+
+    std::vector<ValueType> find(const KeyType &key) const {
+        std::vector<ValueType> values;
+        std::vector<Entry> memory;
+        std::vector<std::shared_ptr<Run>> runs;
+        std::vector<Entry> hidden;
+        snapshotSources(&key, &key, memory, runs, hidden);
+        for (const Entry &entry : memory) values.push_back(entry.value);
+
+        std::vector<Entry> page;
+        for (const auto &run : runs) {
+            for (uint64_t first = run->firstPage(key) * PAGE_ENTRIES; first < run->count; first += PAGE_ENTRIES) {
+                run->read(page, first, PAGE_ENTRIES);
+                if (page.empty() || key < page.front().key) break;
+                for (const Entry &entry : page) {
+                    if (entry.key == key && !std::binary_search(hidden.begin(), hidden.end(), entry, EntryLess())) {
+                        values.push_back(entry.value);
+                    }
+                }
+                if (key < page.back().key) break;
+            }
+        }
+
+        std::sort(values.begin(), values.end());
+        values.erase(std::unique(values.begin(), values.end(), [](const ValueType &a, const ValueType &b) {
+            return !(a < b) && !(b < a);
+        }), values.end());
+        return values;
+    }
+
+    // 按 (键, 值) 升序逐个访问
+    template<typename Visitor>
+    void forEach(Visitor visit) const {
+        scan(nullptr, nullptr, [&](const Entry &entry) {
+            visit(entry.key, entry.value);
+            return true;
+        });
+    }
+
+    // 访问键落在 [low, high] 内的条目
+    template<typename Visitor>
+    void forEachInRange(const KeyType &low, const KeyType &high, Visitor visit) const {
+        if (high < low) return;
+        scan(&low, &high, [&](const Entry &entry) {
+            visit(entry.key, entry.value);
+            return true;
+        });
+    }
+
+    // 当前线程看得到的最大键，没有条目时返回 false。只看内存表末尾与各段文件头，不扫描段
+    bool lastKey(KeyType &key) const {
+        std::shared_lock<std::shared_mutex> lock(latch);
+        bool found = false;
+        auto consider = [&](const KeyType &candidate) {
+            if (!found || key < candidate) key = candidate;
+            found = true;
+        };
+        for (auto it = memtable.rbegin(); it != memtable.rend(); ++it) {
+            if (visible(it->second)) {
+                consider(it->first.key);
+                break;
+            }
+        }
+        if (currentTransaction && !pending.empty()) consider(pending.rbegin()->key);
+        const std::vector<Entry> hidden = hiddenEntries(nullptr, nullptr);
+        for (const auto &level : levels) {
+            for (const auto &run : level) {
+                if (run->count == 0) continue;
+                if (hidden.empty() || hidden.back().key < run->maxKey) {
+                    consider(run->maxKey);
+                    continue;
+                }
+                // 段末尾的条目对本快照不可见：从后往前找第一条可见的
+                std::vector<Entry> page;
+                for (uint64_t first = (run->count - 1) / PAGE_ENTRIES * PAGE_ENTRIES;; first -= PAGE_ENTRIES) {
+                    run->read(page, first, PAGE_ENTRIES);
+                    auto it = std::find_if(page.rbegin(), page.rend(), [&](const Entry &entry) {
+                        return !std::binary_search(hidden.begin(), hidden.end(), entry, EntryLess());
+                    });
+                    if (it != page.rend()) {
+                        consider(it->key);
+                        break;
+                    }
+                    if (first == 0) break;
+                }
+            }
+        }
+        return found;
+    }
+
+    void pruneVersions(long long oldest) override {
+        std::lock_guard<std::mutex> guard(versionMutex);
+        for (auto it = recentVersions.begin(); it != recentVersions.end();) {
+            it = it->second <= oldest ? recentVersions.erase(it) : std::next(it);
+        }
+    }
+
+    std::vector<ValueType> getAllValues() const {
+        std::vector<ValueType> result;
+        forEach([&](const KeyType &, const ValueType &value) { result.push_back(value); });
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+};
+
+#endif //BOOKSTORE_2025_LSM_STORE_H
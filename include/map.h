@@ -6,12 +6,49 @@
 #include <string>
 #include <cstring>
 #include <algorithm>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <array>
+#include <memory>
+#include <cstdint>
+#include <type_traits>
+#include <cstdlib>
+#include <cstddef>
 #include "MemoryRiver.h"
+#include "front_coding.h"
+#include "page_pool.h"
+#include "bloom_filter.h"
+#include "hash_index.h"
+#include "key_hash.h"
+#include "arena.h"
+
+// 块的目标字节数。每个 Map 按自己的键、值大小把目标折算成块容量，
+// 大值（如 BookData）的块装得少，小值（如财务记录）的块装得多
+constexpr size_t BLOCK_4K = 4 << 10;
+constexpr size_t BLOCK_16K = 16 << 10;
+constexpr size_t BLOCK_64K = 64 << 10;
+constexpr size_t BLOCK_256K = 256 << 10;
+
+constexpr bool isBlockTier(const size_t bytes) {
+    return bytes == BLOCK_4K || bytes == BLOCK_16K || bytes == BLOCK_64K || bytes == BLOCK_256K;
+}
+
+// 块格式：定长键值数组，或对字符串键做前缀压缩（见 front_coding.h）
+enum BlockFormat { SORTED_ARRAY, FRONT_CODED };
+
+// Map 的可选附属结构，按位组合。两者都按键的字节计算哈希，键须为 FixedString、整数这类相等即字节相同的类型
+// WITH_KEY_FILTER：键的布隆过滤器（见 bloom_filter.h），适合多是"查无此键"的精确查找
+// WITH_HASH_INDEX：键到所在块的哈希索引（见 hash_index.h），精确查找不再沿链表走，只用于键唯一的表
+enum MapOption : unsigned { NO_OPTIONS = 0, WITH_KEY_FILTER = 1, WITH_HASH_INDEX = 2 };
+
+// 链表只通过以下接口操作块：count、next、min_index、max_index、full()、loadFull()、
+// insert、remove、getAllValues、visit、append、splitInto
+template<typename KeyType, typename ValueType, size_t BlockBytes = BLOCK_16K, BlockFormat Format = SORTED_ARRAY>
+class Map : public TransactionalStore {
+    // 只允许这几档，打开容量不同的旧文件时才能按对应的块格式读出并迁移
+    static_assert(isBlockTier(BlockBytes), "块大小须为 4/16/64/256 KB 之一");
 
-constexpr int BLOCK_SIZE = 1000;
-
-template<typename KeyType, typename ValueType>
-class Map {
 private:
     struct KeyValue {
         KeyType index;
@@ -37,14 +74,46 @@ private:
         }
     };
 
-    struct Block {
+    // 键类型若提供 prefix()（键前 8 字节的大端整数，与键同序），块内查找先比前缀
+    template<typename K, typename = void>
+    struct HasKeyPrefix : std::false_type {};
+    template<typename K>
+    struct HasKeyPrefix<K, std::void_t<decltype(std::declval<const K &>().prefix())>> : std::true_type {};
+    static constexpr bool USE_PREFIX = HasKeyPrefix<KeyType>::value;
+
+    // bytes 字节的块能装下的条目数（扣掉块头，至少 16 条）
+    static constexpr int capacityFor(const size_t bytes) {
+        const size_t entry = sizeof(KeyType) + sizeof(ValueType) + (USE_PREFIX ? sizeof(uint64_t) : 0);
+        const size_t header = 2 * sizeof(KeyType) + 2 * sizeof(int) + 2 * alignof(std::max_align_t);
+        return bytes >= header + 16 * entry ? static_cast<int>((bytes - header) / entry) : 16;
+    }
+
+public:
+    static constexpr int CAPACITY = capacityFor(BlockBytes);
+
+    // 记录句柄：块地址与块内下标，只用于定长数组块。块内插删使下标错位时由比对键发现；
+    // 批量装载、清空、删块、回滚之后旧地址上的内容不再可信，epoch 加一，此前的句柄一律作废
+    struct Handle {
+        int block = -1;
+        int slot = -1;
+        unsigned epoch = 0;
+    };
+
+private:
+
+    // 块内按列存放：前缀、键、值各占一段连续数组，二分查找只碰前缀和键所在的几条缓存行，
+    // 命中后才去读值
+    template<int CAP>
+    struct BlockOf {
         KeyType min_index;
         KeyType max_index;
         int count;
         int next;
-        KeyValue data[BLOCK_SIZE];
+        std::array<uint64_t, USE_PREFIX ? CAP : 0> prefixes;   // 与 keys、values 一样不初始化
+        RawArray<KeyType, CAP> keys;
+        RawArray<ValueType, CAP> values;
 
-        Block() : count(0), next(-1) {
+        BlockOf() : count(0), next(-1) {
             min_index = KeyType();
             max_index = KeyType();
         }
@@ -55,46 +124,92 @@ private:
                 max_index = KeyType();
                 return;
             }
-            min_index = data[0].index;
-            max_index = data[count - 1].index;
+            min_index = keys[0];
+            max_index = keys[count - 1];
         }
 
-        int findValuePos(const KeyValue &kv) const {
-            int left = 0, right = count - 1;
-            while (left <= right) {
-                const int mid = (left + right) / 2;
-                if (data[mid] == kv) return mid;
-                if (data[mid] < kv) left = mid + 1;
-                else right = mid - 1;
-            }
-            return -1;
+        // 把借来的页当作空块使用
+        void reset() {
+            count = 0;
+            next = -1;
+            min_index = KeyType();
+            max_index = KeyType();
         }
 
-        bool insert(const KeyValue &kv) {
-            if (count >= BLOCK_SIZE) return false;
+        void set(const int i, const KeyType &key, const ValueType &value) {
+            if constexpr (USE_PREFIX) prefixes[i] = key.prefix();
+            keys[i] = key;
+            values[i] = value;
+        }
 
-            if (findValuePos(kv) != -1) {
-                return false;
+        // 把 [from, count) 整体移到 to 开始的位置
+        void shift(const int from, const int to) {
+            if (from == to || from >= count) return;
+            if (to > from) {
+                const int end = count + (to - from);
+                if constexpr (USE_PREFIX) {
+                    std::copy_backward(prefixes.begin() + from, prefixes.begin() + count, prefixes.begin() + end);
+                }
+                std::copy_backward(keys + from, keys + count, keys + end);
+                std::copy_backward(values + from, values + count, values + end);
+            } else {
+                if constexpr (USE_PREFIX) {
+                    std::copy(prefixes.begin() + from, prefixes.begin() + count, prefixes.begin() + to);
+                }
+                std::copy(keys + from, keys + count, keys + to);
+                std::copy(values + from, values + count, values + to);
             }
+        }
 
-            int left = 0, right = count - 1;
-            int pos = count;
+        // keys[i] 与 key 的三路比较，前缀不同时不必比整个键
+        int compareKey(const int i, const KeyType &key, const uint64_t keyPrefix) const {
+            if constexpr (USE_PREFIX) {
+                if (prefixes[i] != keyPrefix) return prefixes[i] < keyPrefix ? -1 : 1;
+            }
+            if (keys[i] < key) return -1;
+            if (key < keys[i]) return 1;
+            return 0;
+        }
 
-            while (left <= right) {
-                int mid = (left + right) / 2;
-                if (data[mid] < kv) {
+        // 第一个 (键, 值) 不小于 (key, *value) 的位置；value 为空时只看键
+        int lowerBound(const KeyType &key, const ValueType *value) const {
+            uint64_t keyPrefix = 0;
+            if constexpr (USE_PREFIX) keyPrefix = key.prefix();
+
+            int left = 0, right = count;
+            while (left < right) {
+                const int mid = (left + right) / 2;
+                const int cmp = compareKey(mid, key, keyPrefix);
+                if (cmp < 0 || (cmp == 0 && value && values[mid] < *value)) {
                     left = mid + 1;
                 } else {
-                    right = mid - 1;
-                    pos = mid;
+                    right = mid;
                 }
             }
+            return left;
+        }
+
+        int findValuePos(const KeyType &key, const ValueType &value) const {
+            const int pos = lowerBound(key, &value);
+            if (pos < count && keys[pos] == key && values[pos] == value) return pos;
+            return -1;
+        }
 
-            for (int i = count; i > pos; i--) {
-                data[i] = data[i - 1];
+        bool full() const { return count >= CAP; }
+
+        // 批量装载时每块装入的条目数：留出一成空位，装载后的插入不会立刻分裂
+        bool loadFull() const { return count >= CAP - CAP / 10; }
+
+        bool insert(const KeyType &key, const ValueType &value) {
+            if (count >= CAP) return false;
+
+            const int pos = lowerBound(key, &value);
+            if (pos < count && keys[pos] == key && values[pos] == value) {
+                return false;
             }
 
-            data[pos] = kv;
+            shift(pos, pos + 1);
+            set(pos, key, value);
             count++;
 
             updateMinMax();
@@ -102,90 +217,245 @@ private:
             return true;
         }
 
-        bool remove(const KeyValue &kv) {
-            const int pos = findValuePos(kv);
+        bool remove(const KeyType &key, const ValueType &value) {
+            const int pos = findValuePos(key, value);
             if (pos == -1) return false;
 
-            for (int i = pos; i < count - 1; i++) {
-                data[i] = data[i + 1];
-            }
+            shift(pos + 1, pos);
             count--;
 
-            if (count > 0) {
-                updateMinMax();
-            } else {
-                min_index = KeyType();
-                max_index = KeyType();
-            }
+            updateMinMax();
 
             return true;
         }
 
-        void getAllValues(const KeyType &index, std::vector<ValueType> &values) const {
+        template<typename Values>
+        void getAllValues(const KeyType &index, Values &result) const {
             if (count == 0 || index < min_index || index > max_index) {
                 return;
             }
 
-            int left = 0, right = count - 1, first = -1;
-            while (left <= right) {
-                int mid = (left + right) / 2;
+            for (int i = lowerBound(index, nullptr); i < count && keys[i] == index; i++) {
+                result.push_back(values[i]);
+            }
+        }
 
-                if (data[mid].index == index) {
-                    first = mid;
-                    right = mid - 1;
-                } else if (data[mid].index < index) {
-                    left = mid + 1;
-                } else {
-                    right = mid - 1;
-                }
+        // 按序访问全部条目，visitor 返回 false 时停止并返回 false
+        template<typename Visitor>
+        bool visit(Visitor visitor) const {
+            for (int i = 0; i < count; i++) {
+                if (!visitor(keys[i], values[i])) return false;
             }
+            return true;
+        }
 
-            if (first == -1) return;
+        void append(const KeyType &key, const ValueType &value) {
+            set(count++, key, value);
+            updateMinMax();
+        }
 
-            for (int i = first; i < count && data[i].index == index; i++) {
-                values.push_back(data[i].value);
+        // 把后一半条目移到 right
+        void splitInto(BlockOf &right) {
+            const int mid = count / 2;
+            right.count = 0;
+            for (int i = mid; i < count; i++) {
+                right.set(right.count++, keys[i], values[i]);
             }
+            count = mid;
+            updateMinMax();
+            right.updateMinMax();
         }
     };
 
+    using Block = std::conditional_t<Format == FRONT_CODED,
+                                     FrontCodedBlock<KeyType, ValueType, BlockBytes>, BlockOf<CAPACITY>>;
+
+    // 写在文件第 3 个 int 的块格式标记：定长数组为块容量，前缀压缩为负的块 KB 数
+    static constexpr int LAYOUT = Format == FRONT_CODED ? -static_cast<int>(BlockBytes >> 10) : CAPACITY;
+
+    // 文件第 3 个 int 记块容量。0 为改成按列存放之前的格式，1 为按列存放、容量固定
+    // 为 1000 时的格式，这两种只用于迁移旧数据文件
+    static constexpr int LEGACY_CAPACITY = 1000;
+
+    struct LegacyBlock {
+        KeyType min_index;
+        KeyType max_index;
+        int count;
+        int next;
+        KeyValue data[LEGACY_CAPACITY];
+
+        template<typename Visitor>
+        bool visit(Visitor visitor) const {
+            for (int i = 0; i < count; i++) {
+                if (!visitor(data[i].index, data[i].value)) return false;
+            }
+            return true;
+        }
+    };
+
+    // 批量装载时每次顺序写出的字节数上限
+    static constexpr size_t LOAD_BATCH_BYTES = 4 << 20;
+    // 批量查找时一次读入的块数，与缓冲页池缓存的空闲页数相当
+    static constexpr int MULTI_GET_BLOCKS = 16;
+    // 顺序扫描链表时预读的块数（约 1MB）
+    static constexpr int PREFETCH_BLOCKS = std::max<int>(2, (1 << 20) / sizeof(Block));
+
     MemoryRiver<Block, 3> blockFile;
+    // 读写块用的缓冲页，避免每次在栈上构造整个块
+    mutable PagePool<Block> pages;
     int head;
     int blockCount;
     std::string filename;
+    std::atomic<unsigned> epoch{1};     // 见 Handle
+    // 键过滤器，未启用时为空。进程正常退出时存到 filename.filter，打开时读回后即删除该文件，
+    // 中途崩溃则下次打开时按链表重建
+    std::unique_ptr<BloomFilter> filter;
+    // 哈希索引，未启用时为空。区间扫描、按序遍历和快照读者仍沿链表走
+    std::unique_ptr<HashIndex<KeyType>> hashIndex;
+
+    // 结构闩：读者和不改变链表结构的写者共享持有；建表头、分裂、删除块时独占
+    mutable std::shared_mutex structureLatch;
+    // 块闩：按块地址分片，读块时共享持有，读-改-写一个块时独占持有
+    static constexpr int LATCH_STRIPES = 64;
+    mutable std::shared_mutex blockLatches[LATCH_STRIPES];
+
+    std::shared_mutex &latchOf(const int blockAddr) const {
+        return blockLatches[(blockAddr / sizeof(Block)) % LATCH_STRIPES];
+    }
 
-    void splitBlock(const int blockAddr) {
-        Block oldBlock;
-        blockFile.read(oldBlock, blockAddr);
+    void readBlock(Block &block, const int blockAddr) const {
+        std::shared_lock<std::shared_mutex> latch(latchOf(blockAddr));
+        blockFile.read(block, blockAddr);
+    }
+
+    // 扫描链表时读完 addr 处的块后调用。连着两步下一块都紧跟在当前块后面（批量装载写出的链表
+    // 就是顺着文件排的）时，让内核提前把后面 PREFETCH_BLOCKS 个块读进页缓存，扫描不必每块等一次磁盘；
+    // 分裂出来追加在文件末尾的块不相邻，不预读。prefetched 由每次扫描置 -1，之后为已预读到的位置，
+    // 窗口用掉一半时再往后续上
+    void readAhead(const int addr, const int next, int &prefetched) const {
+        if (next != addr + static_cast<int>(sizeof(Block))) return;
+        if (prefetched < 0) {
+            prefetched = 0;     // 第一步相邻，只记下，短区间扫描不预读
+            return;
+        }
+        const int windowEnd = next + PREFETCH_BLOCKS * static_cast<int>(sizeof(Block));
+        if (prefetched - next > (windowEnd - next) / 2) return;
+        const int from = std::max(next, prefetched);
+        blockFile.prefetch(from, (windowEnd - from) / static_cast<int>(sizeof(Block)));
+        prefetched = windowEnd;
+    }
 
-        if (oldBlock.count < BLOCK_SIZE) return;
+    // 从 current 起沿链表收集 index 的全部值，block 为读块用的缓冲页。调用者需持有结构闩（快照读者除外）
+    template<typename Values>
+    void chainValues(const KeyType &index, int current, Block &block, Values &values) const {
+        int prefetched = -1;
+        while (current != -1) {
+            readBlock(block, current);
+            readAhead(current, block.next, prefetched);
+
+            if (block.count == 0) {
+                current = block.next;
+                continue;
+            }
+
+            if (index >= block.min_index && index <= block.max_index) {
+                block.getAllValues(index, values);
+            } else if (index < block.min_index) {
+                break;
+            }
+
+            current = block.next;
+        }
+    }
 
-        Block newBlock;
-        int mid = oldBlock.count / 2;
+    // 一次读入 addrs 中的各块，targets[i] 读 addrs[i]。按块闩分片升序加锁：
+    // 写者同一时刻至多独占一个块闩，不会与这里互相等待
+    void readBlocks(Block *const *targets, const ArenaVector<int> &addrs) const {
+        ArenaVector<std::shared_mutex *> stripes;
+        stripes.reserve(addrs.size());
+        for (const int addr : addrs) stripes.push_back(&latchOf(addr));
+        std::sort(stripes.begin(), stripes.end());
+        stripes.erase(std::unique(stripes.begin(), stripes.end()), stripes.end());
+        ArenaVector<std::shared_lock<std::shared_mutex>> latches;
+        latches.reserve(stripes.size());
+        for (std::shared_mutex *stripe : stripes) latches.emplace_back(*stripe);
+        blockFile.read(targets, addrs.data(), static_cast<int>(addrs.size()));
+    }
 
-        newBlock.count = oldBlock.count - mid;
-        for (int i = 0; i < newBlock.count; i++) {
-            newBlock.data[i] = oldBlock.data[mid + i];
+    // 读者的结构闩。快照读者沿快照中的链表走，看到的块都是快照时刻的内容，
+    // 与分裂、删块互不干扰，因此不持结构闩，也就不会被写指令挡住
+    std::shared_lock<std::shared_mutex> lockForRead() const {
+        if (currentSnapshot >= 0) {
+            return std::shared_lock<std::shared_mutex>(structureLatch, std::defer_lock);
         }
+        return std::shared_lock<std::shared_mutex>(structureLatch);
+    }
 
-        oldBlock.count = mid;
-        oldBlock.updateMinMax();
-        newBlock.updateMinMax();
+    // 读者看到的表头：快照读者取快照时刻的表头
+    int headForRead() const {
+        if (currentSnapshot < 0) return head;
+        int snapshotHead;
+        blockFile.get_info(snapshotHead, 1);
+        return snapshotHead;
+    }
+
+    // 插入 kv 应落在的块：第一个 max_index >= kv.index 的块，否则为最后一块
+    // 调用者需持有结构闩
+    int locateInsertBlock(const KeyValue &kv) const {
+        int current = head;
+        int last = -1;
+        auto blockPage = pages.acquire();
+        Block &block = *blockPage;
+
+        while (current != -1) {
+            readBlock(block, current);
+            if (kv.index <= block.max_index) {
+                return current;
+            }
+            last = current;
+            current = block.next;
+        }
+        return last;
+    }
+
+    // 调用者需独占结构闩
+    void splitBlock(const int blockAddr) {
+        auto oldBlockPage = pages.acquire();
+        Block &oldBlock = *oldBlockPage;
+        blockFile.read(oldBlock, blockAddr);
+
+        if (!oldBlock.full()) return;
+
+        auto newBlockPage = pages.acquire();
+        Block &newBlock = *newBlockPage;
+        newBlock.reset();
+        oldBlock.splitInto(newBlock);
 
         newBlock.next = oldBlock.next;
         oldBlock.next = blockFile.write(newBlock);
 
         blockFile.update(oldBlock, blockAddr);
+        if (hashIndex) {
+            const int newAddr = oldBlock.next;
+            newBlock.visit([&](const KeyType &key, const ValueType &) {
+                hashIndex->put(key, newAddr);
+                return true;
+            });
+        }
 
         blockCount++;
         blockFile.write_info(blockCount, 2);
     }
 
+    // 调用者需独占结构闩
     void deleteBlock(int blockAddr, int prevAddr) {
-        Block block;
+        auto blockPage = pages.acquire();
+        Block &block = *blockPage;
         blockFile.read(block, blockAddr);
 
         if (prevAddr != -1) {
-            Block prevBlock;
+            auto prevBlockPage = pages.acquire();
+            Block &prevBlock = *prevBlockPage;
             blockFile.read(prevBlock, prevAddr);
             prevBlock.next = block.next;
             blockFile.update(prevBlock, prevAddr);
@@ -196,10 +466,154 @@ private:
 
         blockCount--;
         blockFile.write_info(blockCount, 2);
+        epoch++;
+    }
+
+    // 独占结构闩下删除已经变空的块（期间若又被插入则保留）
+    void deleteIfEmpty(const int blockAddr) {
+        std::unique_lock<std::shared_mutex> structure(structureLatch);
+
+        int current = head;
+        int prevAddr = -1;
+        auto blockPage = pages.acquire();
+        Block &block = *blockPage;
+
+        while (current != -1) {
+            blockFile.read(block, current);
+            if (current == blockAddr) {
+                if (block.count == 0) {
+                    deleteBlock(current, prevAddr);
+                }
+                return;
+            }
+            prevAddr = current;
+            current = block.next;
+        }
+    }
+
+    // 按块格式 B 沿链表读出全部条目
+    template<typename B>
+    void collectEntries(std::vector<std::pair<KeyType, ValueType>> &entries) const {
+        MemoryRiver<B, 3> oldFile(filename);
+        std::unique_ptr<B> block(new B);
+        int current = head;
+        while (current != -1) {
+            oldFile.read(*block, current);
+            block->visit([&](const KeyType &key, const ValueType &value) {
+                entries.emplace_back(key, value);
+                return true;
+            });
+            current = block->next;
+        }
+    }
+
+    // 文件的块格式与当前不同：按文件记录的格式读出全部条目，清空文件后按当前格式重新装载
+    void migrateLayout(const int layout) {
+        std::vector<std::pair<KeyType, ValueType>> entries;
+        if (layout == 0) {
+            collectEntries<LegacyBlock>(entries);
+        } else if (layout == 1 || layout == LEGACY_CAPACITY) {
+            collectEntries<BlockOf<LEGACY_CAPACITY>>(entries);
+        } else if (layout == capacityFor(BLOCK_4K)) {
+            collectEntries<BlockOf<capacityFor(BLOCK_4K)>>(entries);
+        } else if (layout == capacityFor(BLOCK_16K)) {
+            collectEntries<BlockOf<capacityFor(BLOCK_16K)>>(entries);
+        } else if (layout == capacityFor(BLOCK_64K)) {
+            collectEntries<BlockOf<capacityFor(BLOCK_64K)>>(entries);
+        } else if (layout == capacityFor(BLOCK_256K)) {
+            collectEntries<BlockOf<capacityFor(BLOCK_256K)>>(entries);
+        } else if (layout < 0 && migrateFrontCoded(layout, entries)) {
+        } else {
+            std::cerr << filename << ": unknown block layout " << layout << "\n";
+            std::exit(1);
+        }
+
+        blockFile.initialise(filename);
+        head = -1;
+        blockCount = 0;
+        blockFile.write_info(head, 1);
+        blockFile.write_info(blockCount, 2);
+        bulkLoad(entries);
+        blockFile.write_info(LAYOUT, 3);
+    }
+
+    // 前缀压缩格式的旧文件（只有字符串键才可能是这种格式）
+    bool migrateFrontCoded(const int layout, std::vector<std::pair<KeyType, ValueType>> &entries) const {
+        if constexpr (USE_PREFIX) {
+            switch (-layout) {
+                case BLOCK_4K >> 10: collectEntries<FrontCodedBlock<KeyType, ValueType, BLOCK_4K>>(entries); return true;
+                case BLOCK_16K >> 10: collectEntries<FrontCodedBlock<KeyType, ValueType, BLOCK_16K>>(entries); return true;
+                case BLOCK_64K >> 10: collectEntries<FrontCodedBlock<KeyType, ValueType, BLOCK_64K>>(entries); return true;
+                case BLOCK_256K >> 10: collectEntries<FrontCodedBlock<KeyType, ValueType, BLOCK_256K>>(entries); return true;
+                default: return false;
+            }
+        }
+        return false;
+    }
+
+    std::string filterFile() const { return filename + ".filter"; }
+
+    static uint64_t keyHash(const KeyType &key) {
+        return hashBytes(&key, sizeof(KeyType));
+    }
+
+    // 快照读者看的是旧版本，旧版本里的键可能已被删除并在重建时清出过滤器，不能用过滤器排除
+    bool filteredOut(const KeyType &key) const {
+        return filter && currentSnapshot < 0 && !filter->mayContain(keyHash(key));
+    }
+
+    // 按链表上的现有键重建过滤器。调用者需独占结构闩
+    void rebuildFilter() {
+        std::vector<uint64_t> hashes;
+        int current = head;
+        auto blockPage = pages.acquire();
+        Block &block = *blockPage;
+        int prefetched = -1;
+        while (current != -1) {
+            blockFile.read(block, current);
+            readAhead(current, block.next, prefetched);
+            block.visit([&](const KeyType &key, const ValueType &) {
+                hashes.push_back(keyHash(key));
+                return true;
+            });
+            current = block.next;
+        }
+        filter->reset(hashes.size());
+        for (const uint64_t hash : hashes) filter->add(hash);
+    }
+
+    // 按链表上的现有键重建哈希索引。调用者需独占结构闩
+    void rebuildHash() {
+        std::vector<std::pair<KeyType, int>> entries;
+        int current = head;
+        auto blockPage = pages.acquire();
+        Block &block = *blockPage;
+        int prefetched = -1;
+        while (current != -1) {
+            blockFile.read(block, current);
+            readAhead(current, block.next, prefetched);
+            block.visit([&](const KeyType &key, const ValueType &) {
+                entries.emplace_back(key, current);
+                return true;
+            });
+            current = block.next;
+        }
+        hashIndex->rebuild(entries);
+    }
+
+    // 经哈希索引找到 key 所在的块并读入 block；索引中没有 key 时返回 -2，索引不可用时返回 -1。
+    // 调用者需持有结构闩
+    int hashedBlock(const KeyType &key, Block &block) const {
+        if (!hashIndex || currentSnapshot >= 0) return -1;
+        int blockAddr;
+        if (!hashIndex->find(key, blockAddr)) return -2;
+        readBlock(block, blockAddr);
+        return blockAddr;
     }
 
 public:
-    explicit Map(const std::string &fname) : blockFile(fname), filename(fname) {
+    explicit Map(const std::string &fname, const unsigned options = NO_OPTIONS)
+        : blockFile(fname), filename(fname) {
         std::ifstream test(fname);
         if (!test.good()) {
             blockFile.initialise(fname);
@@ -207,110 +621,254 @@ public:
             blockCount = 0;
             blockFile.write_info(head, 1);
             blockFile.write_info(blockCount, 2);
+            blockFile.write_info(LAYOUT, 3);
         } else {
             blockFile.get_info(head, 1);
             blockFile.get_info(blockCount, 2);
+            int layout = 0;
+            blockFile.get_info(layout, 3);
+            if (layout != LAYOUT) migrateLayout(layout);
         }
-    }
-
-    void insert(const KeyType &index, const ValueType &value) {
-        KeyValue kv(index, value);
-
-        if (head == -1) {
-            Block newBlock;
-            newBlock.insert(kv);
-            head = blockFile.write(newBlock);
-            blockCount = 1;
-            blockFile.write_info(head, 1);
-            blockFile.write_info(blockCount, 2);
-            return;
+        if (options & WITH_KEY_FILTER) {
+            filter.reset(new BloomFilter());
+            if (!filter->load(filterFile(), filename)) rebuildFilter();
+            std::remove(filterFile().c_str());
         }
+        if (options & WITH_HASH_INDEX) {
+            hashIndex.reset(new HashIndex<KeyType>(filename));
+            if (!hashIndex->open(filename)) rebuildHash();
+        }
+        TransactionManager::registerStore(this);
+    }
 
-        int current = head;
-        int prevAddr = -1;
-        int targetBlock = -1;
-        Block currentBlock;
-
-        while (current != -1) {
-            blockFile.read(currentBlock, current);
+    ~Map() override {
+        TransactionManager::unregisterStore(this);
+        blockFile.checkpoint();
+        if (filter) filter->save(filterFile(), filename);
+        if (hashIndex) hashIndex->close(filename);
+    }
 
-            if (kv.index <= currentBlock.max_index) {
-                targetBlock = current;
-                break;
-            }
+    void commitBuffered() override {
+        blockFile.flushBuffered();
+        if (hashIndex) hashIndex->flushBuffered();
+    }
 
-            prevAddr = current;
-            current = currentBlock.next;
+    // 丢弃脏块后，表头与块数也要回到文件中的值。事务中删掉的键回来了，
+    // 而事务中若重建过过滤器，这些键已不在其中，因此一并重建
+    void discardBuffered() override {
+        blockFile.discardBuffered();
+        blockFile.get_info(head, 1);
+        blockFile.get_info(blockCount, 2);
+        epoch++;
+        if (hashIndex) hashIndex->discardBuffered();
+        if (filter) {
+            std::unique_lock<std::shared_mutex> structure(structureLatch);
+            rebuildFilter();
         }
+    }
+
+    void insert(const KeyType &index, const ValueType &value) {
+        KeyValue kv(index, value);
 
-        if (targetBlock == -1) {
-            targetBlock = prevAddr;
-            blockFile.read(currentBlock, targetBlock);
+        // 键先进过滤器再进块（都在结构闩下，重建过滤器要独占结构闩，不会漏掉）
+        const uint64_t hash = filter ? keyHash(index) : 0;
+        if (filter && filter->overloaded()) {
+            std::unique_lock<std::shared_mutex> structure(structureLatch);
+            if (filter->overloaded()) rebuildFilter();
         }
 
-        bool inserted = currentBlock.insert(kv);
-        if (inserted) {
-            blockFile.update(currentBlock, targetBlock);
+        while (true) {
+            int fullBlock = -1;     // 需要分裂的块
+            bool inserted = false;  // kv 是否已经写入
+
+            // 快路径：链表结构不变，只独占目标块
+            {
+                std::shared_lock<std::shared_mutex> structure(structureLatch);
+                if (filter) filter->add(hash);
+                if (head != -1) {
+                    const int target = locateInsertBlock(kv);
+                    std::unique_lock<std::shared_mutex> latch(latchOf(target));
+                    auto blockPage = pages.acquire();
+                    Block &block = *blockPage;
+                    blockFile.read(block, target);
+
+                    // 块已满说明别的写者插满后还没来得及分裂，先分裂再重试
+                    if (!block.full()) {
+                        if (hashIndex) hashIndex->put(kv.index, target);
+                        if (block.insert(kv.index, kv.value)) {
+                            blockFile.update(block, target);
+                        }
+                        inserted = true;
+                        if (!block.full()) return;
+                    }
+                    fullBlock = target;
+                }
+            }
 
-            if (currentBlock.count >= BLOCK_SIZE) {
-                splitBlock(targetBlock);
+            // 慢路径：建表头或分裂，需要独占结构闩
+            std::unique_lock<std::shared_mutex> structure(structureLatch);
+            if (filter) filter->add(hash);
+            if (head == -1) {
+                auto newBlockPage = pages.acquire();
+                Block &newBlock = *newBlockPage;
+                newBlock.reset();
+                newBlock.insert(kv.index, kv.value);
+                head = blockFile.write(newBlock);
+                blockCount = 1;
+                blockFile.write_info(head, 1);
+                blockFile.write_info(blockCount, 2);
+                if (hashIndex) hashIndex->put(kv.index, head);
+                return;
+            }
+            if (fullBlock != -1) {
+                splitBlock(fullBlock);
             }
+            if (inserted) return;
         }
     }
 
     void remove(const KeyType &index, const ValueType &value) {
         KeyValue kv(index, value);
+        int emptiedBlock = -1;
 
-        if (head == -1) return;
-
-        int current = head;
-        int prevAddr = -1;
-        Block block;
+        {
+            std::shared_lock<std::shared_mutex> structure(structureLatch);
+            if (head == -1) return;
 
-        while (current != -1) {
-            blockFile.read(block, current);
-
-            if (kv.index >= block.min_index && kv.index <= block.max_index) {
-                if (block.remove(kv)) {
-                    blockFile.update(block, current);
+            int current = head;
+            auto blockPage = pages.acquire();
+            Block &block = *blockPage;
 
-                    if (block.count == 0) {
-                        deleteBlock(current, prevAddr);
+            while (current != -1) {
+                readBlock(block, current);
+
+                if (kv.index >= block.min_index && kv.index <= block.max_index) {
+                    std::unique_lock<std::shared_mutex> latch(latchOf(current));
+                    blockFile.read(block, current);
+
+                    if (block.remove(kv.index, kv.value)) {
+                        blockFile.update(block, current);
+                        if (hashIndex) {
+                            std::vector<ValueType> rest;
+                            block.getAllValues(kv.index, rest);
+                            if (rest.empty()) hashIndex->erase(kv.index, current);
+                        }
+
+                        if (block.count == 0) {
+                            emptiedBlock = current;
+                        }
+                        break;
                     }
-                    return;
+                } else if (kv.index < block.min_index) {
+                    break;
                 }
-            } else if (kv.index < block.min_index) {
-                break;
+
+                current = block.next;
             }
+        }
 
-            prevAddr = current;
-            current = block.next;
+        if (emptiedBlock != -1) {
+            deleteIfEmpty(emptiedBlock);
         }
     }
 
-    std::vector<ValueType> find(const KeyType &index) const{
-        std::vector<ValueType> values;
-
-        if (head != -1) {
-            int current = head;
-            Block block;
+    // 批量装载：entries 须按 (键, 值) 升序排好。与表中原有内容归并后自底向上写成一串
+    // 新块，顺序追加到文件末尾，再把表头指向新链表。原有的块不再被引用，
+    // 快照读者仍可沿快照中的旧表头读到旧内容
+    void bulkLoad(const std::vector<std::pair<KeyType, ValueType>> &entries) {
+        if (entries.empty()) return;
+        std::unique_lock<std::shared_mutex> structure(structureLatch);
+        if (filter) {
+            for (const auto &entry : entries) filter->add(keyHash(entry.first));
+        }
 
-            while (current != -1) {
-                blockFile.read(block, current);
+        const int base = blockFile.endIndex();
+        const size_t perBatch = std::max<size_t>(1, LOAD_BATCH_BYTES / sizeof(Block));
+        // 一批块要连续写出，单独开一段；块的构造只设表头，键值槽位不清零
+        std::unique_ptr<Block[]> batch(new Block[perBatch]);
+        size_t filled = 0;  // 本批已用的块数
+        int written = 0;    // 已写出的块数
+
+        // 新块在文件中连续存放，第 i 块的后继就是第 i+1 块
+        auto flush = [&](const bool last) {
+            for (size_t i = 0; i < filled; i++) {
+                batch[i].next = base + static_cast<int>((written + i + 1) * sizeof(Block));
+            }
+            if (last) batch[filled - 1].next = -1;
+            blockFile.write(batch.get(), static_cast<int>(filled));
+            written += static_cast<int>(filled);
+            filled = 0;
+        };
+
+        bool hasLast = false;
+        KeyValue last;
+        auto append = [&](const KeyValue &kv) {
+            if (hasLast && last == kv) return;
+            if (filled == 0 || batch[filled - 1].loadFull()) {
+                if (filled == perBatch) flush(false);
+                batch[filled++].reset();
+            }
+            batch[filled - 1].append(kv.index, kv.value);
+            last = kv;
+            hasLast = true;
+        };
 
-                if (block.count == 0) {
-                    current = block.next;
-                    continue;
+        size_t pos = 0;
+        int current = head;
+        auto blockPage = pages.acquire();
+        Block &block = *blockPage;
+        int prefetched = -1;
+        while (current != -1) {
+            blockFile.read(block, current);
+            readAhead(current, block.next, prefetched);
+            block.visit([&](const KeyType &key, const ValueType &value) {
+                const KeyValue kv(key, value);
+                while (pos < entries.size() &&
+                       KeyValue(entries[pos].first, entries[pos].second) < kv) {
+                    append(KeyValue(entries[pos].first, entries[pos].second));
+                    pos++;
                 }
+                append(kv);
+                return true;
+            });
+            current = block.next;
+        }
+        for (; pos < entries.size(); pos++) {
+            append(KeyValue(entries[pos].first, entries[pos].second));
+        }
+        flush(true);
 
-                if (index >= block.min_index && index <= block.max_index) {
-                    block.getAllValues(index, values);
-                } else if (index < block.min_index) {
-                    break;
-                }
+        head = base;
+        blockCount = written;
+        blockFile.write_info(head, 1);
+        blockFile.write_info(blockCount, 2);
+        epoch++;
+        if (filter && filter->overloaded()) rebuildFilter();
+        if (hashIndex) rebuildHash();
+    }
 
-                current = block.next;
+    std::vector<ValueType> find(const KeyType &index) const{
+        std::vector<ValueType> values;
+        auto structure = lockForRead();
+        if (filteredOut(index)) return values;
+        const int first = headForRead();
+
+        if (first != -1) {
+            int current = first;
+            auto blockPage = pages.acquire();
+            Block &block = *blockPage;
+
+            // 哈希索引命中时只读一个块；块里没有这个键（不应发生）时仍沿链表找
+            const int hashed = hashedBlock(index, block);
+            if (hashed == -2) return values;
+            if (hashed >= 0 && block.count > 0 && !(index < block.min_index) && !(block.max_index < index)) {
+                block.getAllValues(index, values);
+                if (!values.empty()) {
+                    std::sort(values.begin(), values.end());
+                    return values;
+                }
             }
+            chainValues(index, current, block, values);
         }
 
         std::sort(values.begin(), values.end());
@@ -331,23 +889,263 @@ public:
         }
     }
 
+    // 按链表顺序（即键升序）逐个访问键值对，不拷贝整表
+    template<typename Visitor>
+    void forEach(Visitor visit) const {
+        auto structure = lockForRead();
+        const int first = headForRead();
+        int current = first;
+        auto blockPage = pages.acquire();
+        Block &block = *blockPage;
+        int prefetched = -1;
+
+        while (current != -1) {
+            readBlock(block, current);
+            readAhead(current, block.next, prefetched);
+
+            block.visit([&](const KeyType &key, const ValueType &value) {
+                visit(key, value);
+                return true;
+            });
+
+            current = block.next;
+        }
+    }
+
+    // 按键升序访问，visit 返回 false 时提前结束
+    template<typename Visitor>
+    void forEachWhile(Visitor visit) const {
+        auto structure = lockForRead();
+        const int first = headForRead();
+        int current = first;
+        auto blockPage = pages.acquire();
+        Block &block = *blockPage;
+        int prefetched = -1;
+
+        while (current != -1) {
+            readBlock(block, current);
+            readAhead(current, block.next, prefetched);
+
+            if (!block.visit([&](const KeyType &key, const ValueType &value) { return visit(key, value); })) {
+                return;
+            }
+
+            current = block.next;
+        }
+    }
+
+    // 访问键落在 [low, high] 内的键值对，利用块的 min/max 跳过无关块
+    template<typename Visitor>
+    void forEachInRange(const KeyType &low, const KeyType &high, Visitor visit) const {
+        if (high < low) return;
+
+        auto structure = lockForRead();
+        const int first = headForRead();
+        int current = first;
+        auto blockPage = pages.acquire();
+        Block &block = *blockPage;
+        int prefetched = -1;
+
+        while (current != -1) {
+            readBlock(block, current);
+            readAhead(current, block.next, prefetched);
+
+            if (block.count > 0 && high < block.min_index) {
+                break;
+            }
+
+            if (block.count > 0 && !(block.max_index < low)) {
+                block.visit([&](const KeyType &key, const ValueType &value) {
+                    if (key < low) return true;
+                    if (high < key) return false;
+                    visit(key, value);
+                    return true;
+                });
+            }
+
+            current = block.next;
+        }
+    }
+
+    // 按 keys（须升序）逐个访问这些键的键值对，次序与 forEachInRange 相同。
+    // 键比块少且哈希索引可用时先一次查齐各键所在的块，再按键序每凑够 MULTI_GET_BLOCKS 个
+    // 不同的块一起读（异步读写模式下同时在途），只读这些键所在的块；
+    // 否则沿链表扫一遍 keys 覆盖的区间
+    template<typename Keys, typename Visitor>
+    void forEachOf(const Keys &keys, Visitor visit) const {
+        if (keys.empty()) return;
+
+        // 快照读者平时不持结构闩。这里持住结构闩后快照若仍是最新状态，此后的写者既不能新建块
+        // 也不能改链表结构，索引给出的块都在快照的链表里；按快照读这些块，块里有这个键
+        // 就是它在快照时刻的值，没有（之后被挪走或删掉）时再沿快照链表找
+        std::shared_lock<std::shared_mutex> structure(structureLatch);
+        const bool hashed = hashIndex && static_cast<int>(keys.size()) < blockCount &&
+                            (currentSnapshot < 0 || VersionClock::isLatest(currentSnapshot));
+        if (!hashed) {
+            structure.unlock();
+            size_t pos = 0;
+            forEachInRange(keys.front(), keys.back(), [&](const KeyType &key, const ValueType &value) {
+                while (pos < keys.size() && keys[pos] < key) pos++;
+                if (pos < keys.size() && !(key < keys[pos])) visit(key, value);
+            });
+            return;
+        }
+
+        ArenaVector<int> blocks;
+        hashIndex->find(keys, blocks);
+        ArenaVector<typename PagePool<Block>::Page> blockPages;
+        ArenaVector<Block *> targets;
+        blockPages.reserve(MULTI_GET_BLOCKS);
+        targets.reserve(MULTI_GET_BLOCKS);
+        for (int i = 0; i < MULTI_GET_BLOCKS; i++) {
+            blockPages.push_back(pages.acquire());
+            targets.push_back(&*blockPages.back());
+        }
+        auto chainPage = pages.acquire();
+        const int first = headForRead();
+        ArenaVector<int> batch;
+        ArenaVector<ValueType> values;
+        for (size_t begin = 0; begin < keys.size();) {
+            // 按键序取下一段键，段内涉及的不同块不超过 MULTI_GET_BLOCKS 个
+            batch.clear();
+            size_t end = begin;
+            for (; end < keys.size(); end++) {
+                if (blocks[end] < 0 || std::find(batch.begin(), batch.end(), blocks[end]) != batch.end()) continue;
+                if (static_cast<int>(batch.size()) == MULTI_GET_BLOCKS) break;
+                batch.push_back(blocks[end]);
+            }
+            readBlocks(targets.data(), batch);
+
+            for (size_t k = begin; k < end; k++) {
+                values.clear();
+                if (blocks[k] >= 0) {
+                    const Block &block = *targets[std::find(batch.begin(), batch.end(), blocks[k]) - batch.begin()];
+                    if (block.count > 0 && !(keys[k] < block.min_index) && !(block.max_index < keys[k])) {
+                        block.getAllValues(keys[k], values);
+                    }
+                }
+                // 索引说有、块里却没有：快照之后被挪走了，或是索引出错（不应发生）。
+                // 快照读者还要找快照之后才删掉的键
+                if (values.empty() && (blocks[k] >= 0 || currentSnapshot >= 0)) {
+                    chainValues(keys[k], first, *chainPage, values);
+                }
+                std::sort(values.begin(), values.end());
+                for (const ValueType &value : values) visit(keys[k], value);
+            }
+            begin = end;
+        }
+    }
+
+    // 清空全部条目，文件按当前块格式重新初始化
+    void clear() {
+        std::unique_lock<std::shared_mutex> structure(structureLatch);
+        blockFile.initialise(filename);
+        head = -1;
+        blockCount = 0;
+        blockFile.write_info(head, 1);
+        blockFile.write_info(blockCount, 2);
+        blockFile.write_info(LAYOUT, 3);
+        epoch++;
+        if (filter) filter->reset(0);
+        if (hashIndex) hashIndex->rebuild({});
+    }
+
+    // 查找 key 的第一个值，同时给出它的句柄
+    bool locate(const KeyType &key, ValueType &value, Handle &handle) const {
+        static_assert(Format == SORTED_ARRAY, "句柄只用于定长数组块");
+        auto structure = lockForRead();
+        if (filteredOut(key)) return false;
+        int current = headForRead();
+        auto blockPage = pages.acquire();
+        Block &block = *blockPage;
+
+        const int hashed = hashedBlock(key, block);
+        if (hashed == -2) return false;
+        if (hashed >= 0 && block.count > 0) {
+            const int pos = block.lowerBound(key, nullptr);
+            if (pos < block.count && block.keys[pos] == key) {
+                value = block.values[pos];
+                handle = Handle{hashed, pos, epoch.load()};
+                return true;
+            }
+        }
+
+        while (current != -1) {
+            readBlock(block, current);
+
+            if (block.count > 0) {
+                if (key < block.min_index) return false;
+                if (!(block.max_index < key)) {
+                    const int pos = block.lowerBound(key, nullptr);
+                    if (pos < block.count && block.keys[pos] == key) {
+                        value = block.values[pos];
+                        handle = Handle{current, pos, epoch.load()};
+                        return true;
+                    }
+                }
+            }
+
+            current = block.next;
+        }
+        return false;
+    }
+
+    // 句柄仍指向 key 时直接读出它的值，只读一个块
+    bool readAt(const Handle &handle, const KeyType &key, ValueType &value) const {
+        static_assert(Format == SORTED_ARRAY, "句柄只用于定长数组块");
+        auto structure = lockForRead();
+        if (handle.block < 0 || handle.epoch != epoch.load()) return false;
+
+        auto blockPage = pages.acquire();
+        Block &block = *blockPage;
+        readBlock(block, handle.block);
+        if (handle.slot >= block.count || block.keys[handle.slot] != key) return false;
+        value = block.values[handle.slot];
+        return true;
+    }
+
+    // 句柄仍指向 key 时原地改写它的值。新值须与旧值同序（否则块内次序会乱），不满足时不改
+    bool updateAt(const Handle &handle, const KeyType &key, const ValueType &value) {
+        static_assert(Format == SORTED_ARRAY, "句柄只用于定长数组块");
+        std::shared_lock<std::shared_mutex> structure(structureLatch);
+        if (handle.block < 0 || handle.epoch != epoch.load()) return false;
+
+        std::unique_lock<std::shared_mutex> latch(latchOf(handle.block));
+        auto blockPage = pages.acquire();
+        Block &block = *blockPage;
+        blockFile.read(block, handle.block);
+        const int slot = handle.slot;
+        if (slot >= block.count || block.keys[slot] != key) return false;
+        if (block.values[slot] < value || value < block.values[slot]) return false;
+
+        block.values[slot] = value;
+        blockFile.update(block, handle.block);
+        return true;
+    }
+
     int getHead() const { return head; }
     int getBlockCount() const { return blockCount; }
 
     std::vector<ValueType> getAllValues() const{
         std::vector<ValueType> result;
+        auto structure = lockForRead();
+        const int first = headForRead();
 
-        if (head == -1) return result;
+        if (first == -1) return result;
 
-        int current = head;
-        Block block;
+        int current = first;
+        auto blockPage = pages.acquire();
+        Block &block = *blockPage;
+        int prefetched = -1;
 
         while (current != -1) {
-            blockFile.read(block, current);
+            readBlock(block, current);
+            readAhead(current, block.next, prefetched);
 
-            for (int i = 0; i < block.count; i++) {
-                result.push_back(block.data[i].value);
-            }
+            block.visit([&](const KeyType &, const ValueType &value) {
+                result.push_back(value);
+                return true;
+            });
 
             current = block.next;
         }
@@ -0,0 +1,131 @@
+#ifndef BOOKSTORE_2025_MVCC_H
+#define BOOKSTORE_2025_MVCC_H
+
+#include <mutex>
+#include <condition_variable>
+#include <set>
+#include <vector>
+#include <algorithm>
+#include <climits>
+
+// 多版本并发控制
+// 每条修改数据的指令是一个写版本；写者原地改块前把块的旧内容（前像）留在内存，
+// 标记为“在该版本被淘汰”。读快照记下开始时已提交的版本号 ts，读块时若该块在
+// ts 之后被改过，就取第一个淘汰版本大于 ts 的前像，于是整条指令内的 remove+insert
+// 对快照要么全可见要么全不可见。没有活跃快照时写者不保存前像，没有额外开销。
+
+// 保存了旧版本的存储，快照结束时由 VersionClock 通知其回收
+class VersionedStore {
+public:
+    virtual ~VersionedStore() = default;
+
+    // 丢弃所有活跃快照都用不到的旧版本；oldest 为最老的活跃快照，没有快照时为 LLONG_MAX
+    virtual void pruneVersions(long long oldest) = 0;
+};
+
+class VersionClock {
+private:
+    static inline std::mutex mutex;
+    static inline std::condition_variable writerDone;
+    static inline long long committed = 0;      // 最近提交的写版本
+    static inline bool writerActive = false;    // 写指令互斥执行，至多一个
+    static inline std::multiset<long long> snapshots;
+    static inline std::vector<VersionedStore*> stores;
+
+public:
+    // 开始一个读快照。若有写指令正在执行则等它提交，以免快照看到半条指令
+    static long long beginSnapshot() {
+        std::unique_lock<std::mutex> lock(mutex);
+        writerDone.wait(lock, [] { return !writerActive; });
+        snapshots.insert(committed);
+        return committed;
+    }
+
+    static void endSnapshot(long long ts) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = snapshots.find(ts);
+        if (it != snapshots.end()) snapshots.erase(it);
+
+        const long long oldest = snapshots.empty() ? LLONG_MAX : *snapshots.begin();
+        for (VersionedStore* store : stores) {
+            store->pruneVersions(oldest);
+        }
+    }
+
+    // 开始一条写指令，返回其版本号；newestSnapshot 为最新的活跃快照，没有快照时为 -1
+    static long long beginWrite(long long& newestSnapshot) {
+        std::lock_guard<std::mutex> lock(mutex);
+        writerActive = true;
+        newestSnapshot = snapshots.empty() ? -1 : *snapshots.rbegin();
+        return committed + 1;
+    }
+
+    static void commitWrite(long long version) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            committed = version;
+            writerActive = false;
+        }
+        writerDone.notify_all();
+    }
+
+    // ts 是否仍是最新的已提交状态（之后没有写指令开始过）
+    static bool isLatest(long long ts) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return !writerActive && committed == ts;
+    }
+
+    static void registerStore(VersionedStore* store) {
+        std::lock_guard<std::mutex> lock(mutex);
+        stores.push_back(store);
+    }
+
+    static void unregisterStore(VersionedStore* store) {
+        std::lock_guard<std::mutex> lock(mutex);
+        stores.erase(std::remove(stores.begin(), stores.end(), store), stores.end());
+    }
+};
+
+// 当前线程的读快照，-1 表示读最新数据
+inline thread_local long long currentSnapshot = -1;
+// 当前线程写指令的版本号与开始时最新的活跃快照（-1 表示无需保存前像）
+inline thread_local long long currentWriteVersion = 0;
+inline thread_local long long currentNewestSnapshot = -1;
+
+// 在作用域内让当前线程的读取都落在同一个快照上
+class SnapshotScope {
+private:
+    long long ts;
+
+public:
+    SnapshotScope() : ts(VersionClock::beginSnapshot()) {
+        currentSnapshot = ts;
+    }
+
+    ~SnapshotScope() {
+        currentSnapshot = -1;
+        VersionClock::endSnapshot(ts);
+    }
+
+    SnapshotScope(const SnapshotScope&) = delete;
+    SnapshotScope& operator=(const SnapshotScope&) = delete;
+};
+
+// 在作用域内执行一条写指令，析构时提交版本
+class WriteScope {
+public:
+    WriteScope() {
+        currentWriteVersion = VersionClock::beginWrite(currentNewestSnapshot);
+    }
+
+    ~WriteScope() {
+        VersionClock::commitWrite(currentWriteVersion);
+        currentWriteVersion = 0;
+        currentNewestSnapshot = -1;
+    }
+
+    WriteScope(const WriteScope&) = delete;
+    WriteScope& operator=(const WriteScope&) = delete;
+};
+
+#endif //BOOKSTORE_2025_MVCC_H
@@ -0,0 +1,32 @@
+#ifndef BOOKSTORE_2025_OUTPUT_H
+#define BOOKSTORE_2025_OUTPUT_H
+
+#include <iostream>
+
+// 指令输出流：控制台模式下就是 std::cout；服务器模式下每个工作线程把它
+// 绑定到当前连接的输出缓冲，多个线程同时执行指令时互不干扰
+inline thread_local std::ostream* boundOutput = nullptr;
+
+inline std::ostream& commandOutput() {
+    return boundOutput ? *boundOutput : std::cout;
+}
+
+// 在作用域内把当前线程的指令输出重定向到 os
+class OutputRedirect {
+private:
+    std::ostream* saved;
+
+public:
+    explicit OutputRedirect(std::ostream& os) : saved(boundOutput) {
+        boundOutput = &os;
+    }
+
+    ~OutputRedirect() {
+        boundOutput = saved;
+    }
+
+    OutputRedirect(const OutputRedirect&) = delete;
+    OutputRedirect& operator=(const OutputRedirect&) = delete;
+};
+
+#endif //BOOKSTORE_2025_OUTPUT_H
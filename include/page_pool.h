@@ -0,0 +1,78 @@
+#ifndef BOOKSTORE_2025_PAGE_POOL_H
+#define BOOKSTORE_2025_PAGE_POOL_H
+
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+// 块、桶里按槽位存放的定长数组，构造时不初始化。
+// 这些页要么整块从文件读入，要么 reset() 后当空块用，count 之后的槽位写入前不会被读，
+// 逐个构造（FixedString 要清零）只是白白写一遍几十 KB。元素须可逐字节复制
+template<typename T, size_t N>
+struct RawArray {
+    static_assert(std::is_trivially_copyable<T>::value && std::is_trivially_destructible<T>::value,
+                  "槽位按字节读写");
+
+    alignas(T) unsigned char bytes[sizeof(T) * N];
+
+    operator T *() { return reinterpret_cast<T *>(bytes); }
+    operator const T *() const { return reinterpret_cast<const T *>(bytes); }
+};
+
+// 块缓冲页池
+// Map 读一个块只需要一块能装下它的内存。页在第一次分配时构造一次，之后反复借出、归还，
+// 读块时 MemoryRiver 直接覆盖页的内容，不再每次构造上千个键值，也不占用线程栈。
+// 借出的页内容是上一次用剩的（新页则未初始化），当作新块使用前须先 reset()。
+template<typename T>
+class PagePool {
+private:
+    static constexpr size_t MAX_IDLE = 16;  // 最多缓存的空闲页
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<T>> idle;
+
+    void release(std::unique_ptr<T> page) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (idle.size() < MAX_IDLE) idle.push_back(std::move(page));
+    }
+
+public:
+    // 借出的页，析构时归还
+    class Page {
+    private:
+        PagePool *pool;
+        std::unique_ptr<T> page;
+
+    public:
+        Page(PagePool *owner, std::unique_ptr<T> p) : pool(owner), page(std::move(p)) {}
+        Page(Page &&other) noexcept = default;
+        Page(const Page &) = delete;
+        Page &operator=(const Page &) = delete;
+
+        ~Page() {
+            if (page) pool->release(std::move(page));
+        }
+
+        T &operator*() const { return *page; }
+        T *operator->() const { return page.get(); }
+    };
+
+    PagePool() = default;
+    PagePool(const PagePool &) = delete;
+    PagePool &operator=(const PagePool &) = delete;
+
+    Page acquire() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!idle.empty()) {
+                std::unique_ptr<T> page = std::move(idle.back());
+                idle.pop_back();
+                return Page(this, std::move(page));
+            }
+        }
+        return Page(this, std::unique_ptr<T>(new T));
+    }
+};
+
+#endif //BOOKSTORE_2025_PAGE_POOL_H
@@ -0,0 +1,136 @@
+#ifndef BOOKSTORE_2025_QUERY_CACHE_H
+#define BOOKSTORE_2025_QUERY_CACHE_H
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <algorithm>
+#include "mvcc.h"
+#include "arena.h"
+
+// show 查询结果缓存：按 (过滤类型, 值) 存渲染好的输出行，LRU 淘汰，条目数与总字节数有上限。
+// 失效有两条路：
+// - 每种过滤各有一个索引版本号，索引增删时递增，旧版本的条目不再命中；
+// - 库存、价格等记录内容变化时，丢弃结果里含该 ISBN 的条目。
+// 读者先取票（记下版本），查完再存；期间若有写入（版本变了，或读快照已不是最新状态）就不存，
+// 因此缓存里只有与当前已提交数据一致的结果。
+class QueryCache {
+public:
+    enum Filter { ISBN = 0, NAME, AUTHOR, KEYWORD, FILTER_COUNT };
+
+    struct Ticket {
+        unsigned long long indexVersion;
+        unsigned long long recordVersion;
+    };
+
+private:
+    static constexpr size_t MAX_ENTRIES = 256;
+    static constexpr size_t MAX_BYTES = 4 << 20;
+
+    struct Entry {
+        std::string key;
+        std::shared_ptr<const std::string> rows;    // 命中时共享，不复制
+        unsigned long long indexVersion;
+        std::vector<std::string> isbns;     // 结果中的图书
+    };
+
+    std::list<Entry> lru;   // 表头最近使用
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> entries;   // 键指向 Entry::key
+    size_t bytes = 0;
+    unsigned long long indexVersions[FILTER_COUNT] = {};
+    unsigned long long recordVersion = 0;
+    std::mutex mutex;
+
+    template<typename String>
+    static String keyOf(Filter filter, const std::string& value) {
+        String key(1, static_cast<char>('0' + filter));
+        key += value;
+        return key;
+    }
+
+    static size_t sizeOf(const Entry& entry) {
+        return entry.key.size() + entry.rows->size() + entry.isbns.size() * sizeof(std::string);
+    }
+
+    void erase(std::list<Entry>::iterator it) {
+        bytes -= sizeOf(*it);
+        entries.erase(it->key);
+        lru.erase(it);
+    }
+
+public:
+    bool lookup(Filter filter, const std::string& value, std::shared_ptr<const std::string>& rows) {
+        const ArenaString key = keyOf<ArenaString>(filter, value);
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = entries.find(std::string_view(key.data(), key.size()));
+        if (found == entries.end()) return false;
+
+        auto it = found->second;
+        if (it->indexVersion != indexVersions[filter]) {
+            erase(it);
+            return false;
+        }
+        lru.splice(lru.begin(), lru, it);
+        rows = it->rows;
+        return true;
+    }
+
+    Ticket ticket(Filter filter) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return {indexVersions[filter], recordVersion};
+    }
+
+    void store(Filter filter, const std::string& value, const Ticket& ticket,
+               std::string rows, std::vector<std::string> isbns) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (ticket.indexVersion != indexVersions[filter] || ticket.recordVersion != recordVersion) return;
+        if (currentSnapshot >= 0 && !VersionClock::isLatest(currentSnapshot)) return;
+
+        Entry entry{keyOf<std::string>(filter, value), std::make_shared<const std::string>(std::move(rows)),
+                    ticket.indexVersion, std::move(isbns)};
+        const size_t size = sizeOf(entry);
+        if (size > MAX_BYTES) return;
+
+        auto found = entries.find(entry.key);
+        if (found != entries.end()) erase(found->second);
+        while (!lru.empty() && (lru.size() >= MAX_ENTRIES || bytes + size > MAX_BYTES)) {
+            erase(std::prev(lru.end()));
+        }
+
+        bytes += size;
+        lru.push_front(std::move(entry));
+        entries.emplace(lru.front().key, lru.begin());
+    }
+
+    // 某种索引发生增删
+    void bumpIndex(Filter filter) {
+        std::lock_guard<std::mutex> lock(mutex);
+        indexVersions[filter]++;
+    }
+
+    // 某本书的记录内容变化
+    void touchBook(const std::string& isbn) {
+        std::lock_guard<std::mutex> lock(mutex);
+        recordVersion++;
+        for (auto it = lru.begin(); it != lru.end();) {
+            auto next = std::next(it);
+            if (std::find(it->isbns.begin(), it->isbns.end(), isbn) != it->isbns.end()) erase(it);
+            it = next;
+        }
+    }
+
+    void invalidateAll() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& version : indexVersions) version++;
+        recordVersion++;
+        lru.clear();
+        entries.clear();
+        bytes = 0;
+    }
+};
+
+#endif //BOOKSTORE_2025_QUERY_CACHE_H
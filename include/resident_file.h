@@ -0,0 +1,272 @@
+#ifndef BOOKSTORE_2025_RESIDENT_FILE_H
+#define BOOKSTORE_2025_RESIDENT_FILE_H
+
+#include <iostream>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "io_ring.h"
+
+// 常驻内存模式（./code --resident）：数据量不大（不超过 1e5 本书、帐户）时整个文件放在内存里。
+// 打开时把文件读进内存映像，再重放预写日志；之后读只是内存拷贝，不再有 pread。
+// 写入改映像，并把 (偏移, 长度, 内容) 记入日志 path.journal。只记与映像中旧内容不同的段（按 DIFF_CHUNK 比较）：
+// 改一个块里的一条记录不必把整块记下来。日志先攒在内存里，只在指令结束时（flushAll）一次写出，
+// 指令中途不写日志也不做快照，磁盘上不会出现做了一半的指令，进程崩溃最多丢掉正在执行的那条指令。
+// 指令结束时日志若已长到超过映像大小的四倍（至少 CHECKPOINT_MIN）就做一次快照：映像整体写到 path.tmp，
+// fsync 后改名替换原文件，再 fsync 所在目录，然后删掉日志；关闭时同样做一次。
+// 日志里的写入按原顺序重放，重放已经包含在快照里的写入结果不变，所以快照改名之后、删日志之前崩溃也不要紧。
+//
+// 同一路径在进程内只有一份映像，多个 MemoryRiver 打开同一个文件时共用（见 open）
+inline bool memoryResident = false;
+
+class ResidentFile {
+private:
+    static constexpr size_t CHECKPOINT_MIN = 16 << 20;
+    static constexpr size_t DIFF_CHUNK = 256;       // 比较新旧内容的粒度
+    static constexpr int64_t TRUNCATE = -1;     // 日志中表示截断文件的记录
+    static constexpr size_t CHECKPOINT_CHUNK = 1 << 20;    // 快照分段写出，异步读写模式下各段同时在途
+
+    struct WalRecord {
+        int64_t offset;
+        uint64_t length;
+    };
+
+    std::string path;
+    mutable std::shared_mutex latch;
+    std::vector<char> image;
+    int walFd = -1;
+    std::vector<char> walBuffer;    // 还没写出的日志
+    size_t walBytes = 0;            // 日志总长，含 walBuffer
+    bool dirty = false;     // 上次快照之后是否写过
+
+    static inline std::mutex registryMutex;
+    static inline std::map<std::string, std::weak_ptr<ResidentFile>> registry;
+
+    std::string walFile() const { return path + ".journal"; }
+
+    static bool readAll(const int fd, void *buf, size_t len) {
+        char *p = static_cast<char *>(buf);
+        while (len > 0) {
+            const ssize_t n = ::read(fd, p, len);
+            if (n <= 0) return false;
+            p += n;
+            len -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    static bool writeAll(const int fd, const void *buf, size_t len) {
+        const char *p = static_cast<const char *>(buf);
+        while (len > 0) {
+            const ssize_t n = ::write(fd, p, len);
+            if (n <= 0) return false;
+            p += n;
+            len -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    void apply(const int64_t offset, const char *data, const size_t length) {
+        if (offset == TRUNCATE) {
+            image.clear();
+            return;
+        }
+        if (image.size() < offset + length) image.resize(offset + length);
+        memcpy(image.data() + offset, data, length);
+    }
+
+    void load() {
+        const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) return;
+        struct stat st;
+        if (::fstat(fd, &st) == 0) {
+            image.resize(static_cast<size_t>(st.st_size));
+            if (!readAll(fd, image.data(), image.size())) image.clear();
+        }
+        ::close(fd);
+
+        // 重放上次没来得及写进快照的日志，末尾写了一半的记录丢弃
+        const int wal = ::open(walFile().c_str(), O_RDONLY | O_CLOEXEC);
+        if (wal < 0) return;
+        WalRecord record;
+        std::vector<char> data;
+        while (readAll(wal, &record, sizeof(record))) {
+            data.resize(record.length);
+            if (!readAll(wal, data.data(), data.size())) break;
+            apply(record.offset, data.data(), data.size());
+            dirty = true;
+        }
+        ::close(wal);
+        // 重放过的内容先落进快照，日志从头开始
+        if (dirty) checkpointLocked();
+    }
+
+    // 调用者需独占 latch
+    void appendWal(const int64_t offset, const char *data, const size_t length) {
+        const WalRecord record{offset, length};
+        const char *header = reinterpret_cast<const char *>(&record);
+        walBuffer.insert(walBuffer.end(), header, header + sizeof(record));
+        walBuffer.insert(walBuffer.end(), data, data + length);
+        walBytes += sizeof(record) + length;
+        dirty = true;
+    }
+
+    // 调用者需持有 latch
+    bool checkpointDue() const {
+        return walBytes > std::max(CHECKPOINT_MIN, image.size() * 4);
+    }
+
+    // 调用者需独占 latch
+    void flushLocked() {
+        if (walBuffer.empty()) return;
+        if (walFd < 0) {
+            walFd = ::open(walFile().c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        }
+        if (walFd < 0 || !writeAll(walFd, walBuffer.data(), walBuffer.size())) {
+            std::cerr << path << ": write-ahead log append failed\n";
+        }
+        walBuffer.clear();
+    }
+
+    void syncDirectory() const {
+        const size_t slash = path.find_last_of('/');
+        const std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+        const int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) return;
+        ::fsync(fd);
+        ::close(fd);
+    }
+
+    // 调用者需独占 latch
+    void checkpointLocked() {
+        if (!dirty) return;
+        const std::string tmp = path + ".tmp";
+        const int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) return;
+        std::vector<IoRing::Request> requests;
+        for (size_t at = 0; at < image.size(); at += CHECKPOINT_CHUNK) {
+            requests.push_back({fd, true, image.data() + at, std::min(CHECKPOINT_CHUNK, image.size() - at),
+                                static_cast<long long>(at)});
+        }
+        // 快照落盘后才改名，改名落盘（目录 fsync）后才删日志：任何时候崩溃，磁盘上都有完整的文件加日志
+        const bool ok = IoRing::run(requests) && ::fsync(fd) == 0;
+        if (::close(fd) != 0 || !ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+            std::remove(tmp.c_str());
+            std::cerr << path << ": checkpoint failed\n";
+            return;
+        }
+        syncDirectory();
+        if (walFd >= 0) {
+            ::close(walFd);
+            walFd = -1;
+        }
+        std::remove(walFile().c_str());
+        walBuffer.clear();
+        walBytes = 0;
+        dirty = false;
+    }
+
+    explicit ResidentFile(std::string p) : path(std::move(p)) { load(); }
+
+public:
+    ResidentFile(const ResidentFile &) = delete;
+    ResidentFile &operator=(const ResidentFile &) = delete;
+
+    ~ResidentFile() {
+        flushLocked();
+        checkpointLocked();
+        if (walFd >= 0) ::close(walFd);
+    }
+
+    // 取 path 的映像，进程内已经打开的直接共用
+    static std::shared_ptr<ResidentFile> open(const std::string &path) {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        std::shared_ptr<ResidentFile> file = registry[path].lock();
+        if (!file) {
+            file.reset(new ResidentFile(path));
+            registry[path] = file;
+        }
+        return file;
+    }
+
+    // 把所有映像攒下的日志写出，日志过长的顺带做快照。每条修改数据的指令结束、放开指令闩之前调用
+    static void flushAll() {
+        std::vector<std::shared_ptr<ResidentFile>> files;
+        {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            for (const auto &item : registry) {
+                if (std::shared_ptr<ResidentFile> file = item.second.lock()) files.push_back(file);
+            }
+        }
+        for (const auto &file : files) {
+            std::unique_lock<std::shared_mutex> lock(file->latch);
+            if (file->checkpointDue()) file->checkpointLocked();
+            file->flushLocked();     // 快照失败时日志照常写出
+        }
+    }
+
+    // 与 pread 一样，超出文件末尾的部分不读，buf 中对应内容保持原样
+    void read(void *buf, const size_t len, const long long offset) const {
+        std::shared_lock<std::shared_mutex> lock(latch);
+        const size_t begin = std::min(image.size(), static_cast<size_t>(offset));
+        memcpy(buf, image.data() + begin, std::min(len, image.size() - begin));
+    }
+
+    void write(const void *buf, const size_t len, const long long offset) {
+        const char *data = static_cast<const char *>(buf);
+        std::unique_lock<std::shared_mutex> lock(latch);
+        // 找出与旧内容不同的段，相邻的合成一段；超出文件末尾的部分总要记
+        const size_t old = offset < static_cast<long long>(image.size()) ?
+                           std::min(len, image.size() - static_cast<size_t>(offset)) : 0;
+        const char *current = image.data() + std::min(image.size(), static_cast<size_t>(offset));
+        auto unchanged = [&](const size_t at) {
+            const size_t n = std::min(DIFF_CHUNK, len - at);
+            return at + n <= old && memcmp(current + at, data + at, n) == 0;
+        };
+        std::vector<std::pair<size_t, size_t>> changed;
+        for (size_t at = 0; at < len;) {
+            if (unchanged(at)) {
+                at += DIFF_CHUNK;
+                continue;
+            }
+            const size_t begin = at;
+            while (at < len && !unchanged(at)) at += DIFF_CHUNK;
+            changed.emplace_back(begin, std::min(at, len));
+        }
+        if (changed.empty()) return;
+
+        apply(offset, data, len);
+        for (const auto &range : changed) {
+            appendWal(offset + range.first, data + range.first, range.second - range.first);
+        }
+    }
+
+    long long size() const {
+        std::shared_lock<std::shared_mutex> lock(latch);
+        return static_cast<long long>(image.size());
+    }
+
+    void truncate() {
+        std::unique_lock<std::shared_mutex> lock(latch);
+        image.clear();
+        appendWal(TRUNCATE, "", 0);
+    }
+
+    // 立即做一次快照，之后磁盘上的文件与映像一致
+    void checkpoint() {
+        std::unique_lock<std::shared_mutex> lock(latch);
+        checkpointLocked();
+    }
+};
+
+#endif //BOOKSTORE_2025_RESIDENT_FILE_H
@@ -0,0 +1,106 @@
+#ifndef BOOKSTORE_2025_SERVER_H
+#define BOOKSTORE_2025_SERVER_H
+
+#include <string>
+#include <memory>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include "bookstore.h"
+
+// 服务器模式：在本地 Unix 域套接字上监听，多个终端共享同一个 Bookstore 进程。
+// 每个连接是一个独立会话（自己的登录栈）。epoll 事件循环负责收发，
+// 指令交给工作线程池执行；同一连接的指令按顺序逐条执行。
+// 指令的输出边执行边分段交给连接的输出缓冲，缓冲积压到 OUTPUT_LIMIT 时工作线程停下来等对端读走，
+// 整份日志、报表不会整个攒在内存里。有工作线程这样停着（或在等其他会话的事务）、又有指令等不到空闲线程时，
+// 线程池加开一个线程，慢连接和未结束的事务不会拖住其他连接
+class BookstoreServer {
+private:
+    struct Connection {
+        int fd;
+        std::string inBuffer;              // 尚未凑成整行的输入
+        std::deque<std::string> pending;   // 等待执行的指令
+        LoginStack loginStack;
+        bool busy;                         // 有一条指令（或断开时的会话清理）正在工作线程中执行
+        bool closing;                      // 收到 quit/exit 或对端关闭，处理完即断开
+        bool registered;                   // 是否仍在 epoll 中
+        bool detaching;                    // 已把关闭会话交给工作线程
+        bool sessionClosed;                // 会话已在工作线程中关闭
+
+        // 工作线程写、事件循环读，由 outMutex 保护
+        std::mutex outMutex;
+        std::condition_variable outDrained;
+        std::string outBuffer;             // 尚未写出的输出
+        bool discardOutput;                // 对端已断开或服务器正在关闭，输出直接丢弃
+
+        explicit Connection(int f)
+            : fd(f), busy(false), closing(false), registered(false), detaching(false), sessionClosed(false),
+              discardOutput(false) {}
+    };
+
+    struct Task {
+        int fd;
+        Connection* conn;
+        std::string line;
+        bool detach;    // 不执行指令，而是关闭会话（回滚未提交的事务）
+    };
+
+    struct Completion {
+        int fd;
+        bool finished;      // 为 false 时只是又有一段输出可写
+        bool keepGoing;
+    };
+
+    class OutputStream;
+
+    Bookstore& bookstore;
+    std::string socketPath;
+    int listenFd;
+    int epollFd;
+    int wakeFd;     // eventfd：工作线程执行完指令后唤醒事件循环
+    unsigned workerCount;
+    std::unordered_map<int, std::unique_ptr<Connection>> connections;
+
+    std::vector<std::thread> workers;
+    std::deque<Task> tasks;
+    std::mutex taskMutex;
+    std::condition_variable taskReady;
+    bool stopping;
+    unsigned idleWorkers;       // 正在等指令的工作线程数，由 taskMutex 保护
+    unsigned stalledWorkers;    // 正在等连接写出输出的工作线程数，由 taskMutex 保护
+
+    std::vector<Completion> completions;
+    std::mutex completionMutex;
+
+    bool setupListener();
+    void startWorkers(unsigned count);
+    void growIfStarved();
+    void stopWorkers();
+    void workerLoop();
+    void deliver(Connection& conn, const char* data, size_t length);
+    void postCompletion(const Completion& completion);
+
+    void acceptConnections();
+    void handleReadable(Connection& conn);
+    void handleWritable(Connection& conn);
+    void handleCompletions();
+    void splitLines(Connection& conn);
+    void dispatchNext(Connection& conn);
+    bool hasOutput(Connection& conn);
+    void finishEvent(Connection& conn);
+    void closeConnection(int fd);
+    void shutdown();
+
+public:
+    // workerCount 为 0 时按 CPU 核数创建工作线程
+    BookstoreServer(Bookstore& store, std::string path, unsigned workerCount = 0);
+    ~BookstoreServer();
+
+    // 运行事件循环，收到 SIGINT/SIGTERM 后退出；启动失败返回 false
+    bool run();
+};
+
+#endif //BOOKSTORE_2025_SERVER_H
@@ -4,6 +4,12 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <string_view>
+#include "arena.h"
+
+// 一条指令的分词结果：指向指令原文的视图，表本身从指令的区域分配。
+// 原文须活过分词结果；要存下来或交给只收 std::string 的接口时再转成 std::string
+using Tokens = ArenaVector<std::string_view>;
 
 std::vector<std::string> tokenize(const std::string &s);
 
@@ -0,0 +1,73 @@
+#ifndef BOOKSTORE_2025_TRANSACTION_H
+#define BOOKSTORE_2025_TRANSACTION_H
+
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+// 多指令事务
+// begin 之后，事务所属会话的每次块写入都只进入各文件的内存脏块表，读取时优先读脏块；
+// 其他会话看不到这些修改。commit 时每个文件按地址排序、把相邻块合并成一次写出，
+// 同一个块在事务内无论改了多少次都只落盘一次；rollback 直接丢弃脏块表。
+
+// 能缓冲写入的存储
+class TransactionalStore {
+public:
+    virtual ~TransactionalStore() = default;
+
+    // 把缓冲的修改写入文件
+    virtual void commitBuffered() = 0;
+    // 丢弃缓冲的修改，恢复到事务开始时的状态
+    virtual void discardBuffered() = 0;
+};
+
+class TransactionManager {
+private:
+    static inline std::mutex mutex;
+    static inline std::vector<TransactionalStore*> stores;
+
+public:
+    static void commitAll() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (TransactionalStore* store : stores) {
+            store->commitBuffered();
+        }
+    }
+
+    static void discardAll() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (TransactionalStore* store : stores) {
+            store->discardBuffered();
+        }
+    }
+
+    static void registerStore(TransactionalStore* store) {
+        std::lock_guard<std::mutex> lock(mutex);
+        stores.push_back(store);
+    }
+
+    static void unregisterStore(TransactionalStore* store) {
+        std::lock_guard<std::mutex> lock(mutex);
+        stores.erase(std::remove(stores.begin(), stores.end(), store), stores.end());
+    }
+};
+
+// 当前线程是否在为事务所属会话执行指令；为真时写入进入脏块表
+inline thread_local bool currentTransaction = false;
+
+// 在作用域内把当前线程的读写导向事务的脏块表
+class TransactionScope {
+public:
+    TransactionScope() {
+        currentTransaction = true;
+    }
+
+    ~TransactionScope() {
+        currentTransaction = false;
+    }
+
+    TransactionScope(const TransactionScope&) = delete;
+    TransactionScope& operator=(const TransactionScope&) = delete;
+};
+
+#endif //BOOKSTORE_2025_TRANSACTION_H
@@ -21,8 +21,14 @@ bool fileExists(const std::string& filename) {
     return f.good();
 }
 
+namespace {
+    // 每个线程绑定的会话登录栈，未绑定时使用控制台会话
+    thread_local LoginStack* boundStack = nullptr;
+}
+
 AccountSystem::AccountSystem(const std::string& filename)
-    : accountMap(filename), accountFile(filename) {
+    : accountMap(filename, WITH_KEY_FILTER | WITH_HASH_INDEX), accountFile(filename) {
+    sessionStacks.push_back(&consoleStack);
     if (!userExists("root")) {
         initialize();
     }
@@ -104,9 +110,9 @@ bool AccountSystem::login(const std::string& userID, const std::string& password
     const Account tmp = getUser(userID);
 
     if (password.empty()) {
-        if (loginStack.empty()) return false;
+        if (currentStack()->empty()) return false;
         if (getCurrentPrivilege() <= tmp.getPrivilege()) return false;
-        loginStack.push_back(LoginInfo(tmp));
+        currentStack()->push_back(LoginInfo(tmp));
         return true;
     }
     else {
@@ -116,15 +122,15 @@ bool AccountSystem::login(const std::string& userID, const std::string& password
         if (tmp.getPassword() != password) {
             return false;
         }
-        loginStack.push_back(LoginInfo(tmp));
+        currentStack()->push_back(LoginInfo(tmp));
         return true;
     }
 }
 bool AccountSystem::logout() {
-    if (loginStack.empty()) {
+    if (currentStack()->empty()) {
         return false;
     }
-    loginStack.pop_back();
+    currentStack()->pop_back();
     return true;
 }
 
@@ -211,56 +217,72 @@ bool AccountSystem::deleteUser(const std::string& userID) {
 
 // 权限和状态查询
 int AccountSystem::getCurrentPrivilege() const {
-    if (loginStack.empty()) return 0;
-    return loginStack.back().getAccount().getPrivilege();
+    if (currentStack()->empty()) return 0;
+    return currentStack()->back().getAccount().getPrivilege();
 }
 
 Account AccountSystem::getCurrentAccount() const {
-    if (loginStack.empty()) return Account();
-    return loginStack.back().getAccount();
+    if (currentStack()->empty()) return Account();
+    return currentStack()->back().getAccount();
 }
 
 std::string AccountSystem::getCurrentUserID() const {
-    if (loginStack.empty())  return "";
-    return loginStack.back().getAccount().getUserID();
+    if (currentStack()->empty())  return "";
+    return currentStack()->back().getAccount().getUserID();
 }
 
 bool AccountSystem::isLoggedIn() const {
-    return !loginStack.empty();
+    return !currentStack()->empty();
 }
 
 
 // 图书选择相关
-bool AccountSystem::selectBook(const std::string& ISBN) {
-    if (loginStack.empty())  return false;
-    loginStack.back().setSelectedISBN(ISBN);
+bool AccountSystem::selectBook(const std::string& ISBN, const BookHandle& handle) {
+    if (currentStack()->empty())  return false;
+    currentStack()->back().setSelectedISBN(ISBN, handle);
     return true;
 }
 
 
 std::string AccountSystem::getSelectedISBN() const {
-    if (loginStack.empty()) {
+    if (currentStack()->empty()) {
         return "";
     }
-    return loginStack.back().getSelectedISBN();
+    return currentStack()->back().getSelectedISBN();
+}
+
+BookHandle AccountSystem::getSelectedHandle() const {
+    if (currentStack()->empty()) {
+        return BookHandle();
+    }
+    return currentStack()->back().getSelectedHandle();
+}
+
+void AccountSystem::setSelectedHandle(const BookHandle& handle) {
+    if (!currentStack()->empty()) {
+        currentStack()->back().setSelectedHandle(handle);
+    }
 }
 
 void AccountSystem::clearSelectedBook() {
-    if (!loginStack.empty()) {
-        loginStack.back().clearSelectedISBN();
+    if (!currentStack()->empty()) {
+        currentStack()->back().clearSelectedISBN();
     }
 }
 
 size_t AccountSystem::getLoginStackSize() const {
-    return loginStack.size();
+    return currentStack()->size();
 }
 
 
 // 登录栈操作
 bool AccountSystem::isUserLoggedIn(const std::string& userID) const {
-    for (const auto& loginInfo : loginStack) {
-        if (loginInfo.getAccount().getUserID() == userID) {
-            return true;
+    std::lock_guard<std::mutex> lock(sessionMutex);
+    for (const LoginStack* stack : sessionStacks) {
+        for (const auto& loginInfo : *stack) {
+            if (loginInfo.getAccount().getUserID() == userID) {
+                return true;
+            }
         }
     }
     return false;
@@ -271,10 +293,35 @@ bool AccountSystem::hasPrivilege(const int required) const {
 }
 
 void AccountSystem::updateSelectedISBNForAll(const std::string& oldISBN, const std::string& newISBN) {
-    for (auto& loginInfo : loginStack) {
-        if (loginInfo.getSelectedISBN() == oldISBN) {
-            loginInfo.setSelectedISBN(newISBN);
+    std::lock_guard<std::mutex> lock(sessionMutex);
+    for (LoginStack* stack : sessionStacks) {
+        for (auto& loginInfo : *stack) {
+            if (loginInfo.getSelectedISBN() == oldISBN) {
+                loginInfo.setSelectedISBN(newISBN);
+            }
         }
     }
 }
 
+// 会话管理
+LoginStack* AccountSystem::currentStack() const {
+    return boundStack ? boundStack : &consoleStack;
+}
+
+void AccountSystem::attachSession(LoginStack* stack) {
+    std::lock_guard<std::mutex> lock(sessionMutex);
+    sessionStacks.push_back(stack);
+}
+
+void AccountSystem::detachSession(LoginStack* stack) {
+    std::lock_guard<std::mutex> lock(sessionMutex);
+    sessionStacks.erase(std::remove(sessionStacks.begin(), sessionStacks.end(), stack),
+                        sessionStacks.end());
+    if (boundStack == stack) {
+        boundStack = nullptr;
+    }
+}
+
+void AccountSystem::switchSession(LoginStack* stack) {
+    boundStack = stack;
+}
@@ -2,15 +2,105 @@
 #include "../include/parser.h"
 #include "../include/token.h"
 #include <unordered_set>
+#include <ctime>
+#include <fstream>
+#include <memory>
+#include <cstdio>
+#include "../include/external_sort.h"
+
+namespace {
+    // 最早格式的 Map 文件：3 个 int 的文件头（表头、块数、格式标记 0）之后是一串块，
+    // 每块为 min/max/count/next 加 1000 个 (编号, 记录)，块的位置即文件中的字节偏移
+    constexpr int LEGACY_FINANCE_CAPACITY = 1000;
+
+    template<typename Record>
+    struct LegacyFinanceBlock {
+        struct Item {
+            int id;
+            Record record;
+        };
+        int min_index;
+        int max_index;
+        int count;
+        int next;
+        Item data[LEGACY_FINANCE_CAPACITY];
+    };
+
+    FinanceRecord toFinanceRecord(const LegacyFinanceRecord& record) { return FinanceRecord(record); }
+    FinanceRecord toFinanceRecord(const FinanceRecord& record) { return record; }
+
+    // 把最早格式的财务文件当作记录为 Record 的块链表读出。文件长度、块的位置、条目数与链表长度
+    // 都须对得上，对不上说明记录不是这种格式，返回 false
+    template<typename Record>
+    bool readLegacyFinance(const std::string& fileName, std::vector<std::pair<int, FinanceRecord>>& entries) {
+        using Block = LegacyFinanceBlock<Record>;
+        constexpr long long HEADER = 3 * sizeof(int);
+        entries.clear();
+        std::ifstream in(fileName, std::ios::binary);
+        int header[3];
+        if (!in.read(reinterpret_cast<char*>(header), sizeof(header))) return false;
+        in.seekg(0, std::ios::end);
+        const long long size = in.tellg();
+        if (size < HEADER || (size - HEADER) % static_cast<long long>(sizeof(Block)) != 0) return false;
+        const long long blocks = (size - HEADER) / static_cast<long long>(sizeof(Block));
+
+        std::unique_ptr<Block> block(new Block);
+        long long visited = 0;
+        for (int current = header[0]; current != -1; current = block->next) {
+            if (visited++ == blocks || current < HEADER || current >= size ||
+                (current - HEADER) % static_cast<long long>(sizeof(Block)) != 0) {
+                return false;
+            }
+            in.seekg(current);
+            if (!in.read(reinterpret_cast<char*>(block.get()), sizeof(Block))) return false;
+            if (block->count < 0 || block->count > LEGACY_FINANCE_CAPACITY) return false;
+            for (int i = 0; i < block->count; i++) {
+                entries.emplace_back(block->data[i].id, toFinanceRecord(block->data[i].record));
+            }
+        }
+        return true;
+    }
+
+    // 导出时外部排序的内存预算
+    constexpr size_t EXPORT_SORT_BUDGET = 16 << 20;
+    // 拆分目录文件的一行：含制表符按 TSV 处理，否则按 CSV 处理（字段可用双引号括起）
+    std::vector<std::string> splitCatalogLine(const std::string& line) {
+        const char delimiter = line.find('\t') != std::string::npos ? '\t' : ',';
+        std::vector<std::string> fields;
+        std::string field;
+        bool quoted = false;
+
+        for (char c : line) {
+            if (delimiter == ',' && c == '\"') {
+                quoted = !quoted;
+            } else if (c == delimiter && !quoted) {
+                fields.push_back(field);
+                field.clear();
+            } else {
+                field += c;
+            }
+        }
+        fields.push_back(field);
+        return fields;
+    }
+
+    // 以 less 为序输出全部图书：内存放不下时排成顺段落到临时文件再归并
+    template<class Less>
+    bool writeSorted(const Map<ISBNIndex, BookData, BLOCK_64K>& books, std::ostream& out, Less less) {
+        ExternalSorter<BookData, Less> sorter(EXPORT_SORT_BUDGET, less);
+        books.forEach([&](const ISBNIndex&, const BookData& book) { sorter.add(book); });
+        return sorter.finish([&](const BookData& book) { out << book << "\n"; });
+    }
+}
 
-BookData::BookData() :Price(0.0), Stock(0){
+BookData::BookData() :book_id(0), Price(0.0), Stock(0){
     memset(ISBN, 0, sizeof(ISBN));
     memset(BookName, 0, sizeof(BookName));
     memset(Author, 0, sizeof(Author));
     memset(Keywords, 0, sizeof(Keywords));
 }
 
-BookData::BookData(const std::string& isbn)  :Price(0.0), Stock(0){
+BookData::BookData(const std::string& isbn)  :book_id(0), Price(0.0), Stock(0){
     setISBN(isbn);
     memset(BookName, 0, sizeof(BookName));
     memset(Author, 0, sizeof(Author));
@@ -18,7 +108,7 @@ BookData::BookData(const std::string& isbn)  :Price(0.0), Stock(0){
 }
 
 BookData::BookData(const std::string& isbn, const std::string& name, const std::string& author, const std::string& keywords, double price, long long stock)
-    :Price(price), Stock(stock){
+    :book_id(0), Price(price), Stock(stock){
     setISBN(isbn);
     setKeywords(keywords);
     setBookName(name);
@@ -84,8 +174,8 @@ bool BookData::isValid() const {
     return strlen(ISBN) > 0;
 }
 
-std::vector<std::string> BookData::getAllKeywords() const {
-    std::vector<std::string> res;
+ArenaVector<std::string> BookData::getAllKeywords() const {
+    ArenaVector<std::string> res;
     std::string s = "";
     for (char c : Keywords) {
         if (c == '|') {
@@ -103,19 +193,35 @@ std::vector<std::string> BookData::getAllKeywords() const {
 }
 
 std::string BookData::toString() const {
-    std::ostringstream oss;
-    oss << std::fixed << std::setprecision(2);
-    oss << getISBN() << "\t"
-        << getBookName() << "\t"
-        << getAuthor() << "\t"
-        << getKeywords() << "\t"
-        << Price << "\t"
-        << Stock;
-    return oss.str();
+    std::string s;
+    appendTo(s);
+    return s;
+}
+
+// 价格按 std::fixed、两位小数的格式输出（与 printf 的 %.2f 相同），不经 ostringstream
+void BookData::appendTo(std::string& out) const {
+    char number[32];
+    out.append(ISBN).append(1, '\t');
+    out.append(BookName).append(1, '\t');
+    out.append(Author).append(1, '\t');
+    out.append(Keywords).append(1, '\t');
+    const int length = std::snprintf(number, sizeof(number), "%.2f", Price);
+    if (length < static_cast<int>(sizeof(number))) {
+        out.append(number, length);
+    } else {
+        std::vector<char> wide(length + 1);
+        std::snprintf(wide.data(), wide.size(), "%.2f", Price);
+        out.append(wide.data(), length);
+    }
+    out.append(1, '\t');
+    out.append(number, std::snprintf(number, sizeof(number), "%lld", Stock));
 }
 
 std::ostream& operator<<(std::ostream& os, const BookData& book) {
-    os << book.toString();
+    thread_local std::string line;  // 反复使用，不必每行分配
+    line.clear();
+    book.appendTo(line);
+    os << line;
     return os;
 }
 
@@ -148,11 +254,142 @@ bool BookData::hasKeyword(const std::string& keyword) const {
 
 
 BookSystem::BookSystem(const std::string& baseFileName)
-    : isbnMap(baseFileName + "_isbn"),
-      nameIndex(baseFileName + "_name"),
-      authorIndex(baseFileName + "_author"),
-      keywordIndex(baseFileName + "_keyword") ,
-      financeSystem(baseFileName) {};
+    : isbnMap(baseFileName + "_isbn", WITH_KEY_FILTER | WITH_HASH_INDEX),
+      idIndex(baseFileName + "_book_id", WITH_HASH_INDEX),
+      nextBookId(1),
+      nameIndex(baseFileName + "_name_id"),
+      authorIndex(baseFileName + "_author_id"),
+      keywordIndex(baseFileName + "_keyword_id"),
+      priceIndex(baseFileName + "_price_id"),
+      stockIndex(baseFileName + "_stock_id"),
+      salesMap(baseFileName + "_sales_id", WITH_HASH_INDEX),
+      salesRank(baseFileName + "_sales_rank_id"),
+      financeSystem(baseFileName) {
+    // 还没有图书编号的旧数据：补分配编号，按编号重建各索引
+    if (idIndex.getHead() == -1 && isbnMap.getHead() != -1) {
+        migrateToBookIds(baseFileName);
+    }
+    updateNextBookId();
+}
+
+// 按 ISBN 顺序给已有图书编号，重写 ISBN 表、重建其余索引，销量记录按编号搬过去。
+// 旧的以 ISBN 为值的索引文件（更早的数据可能没有价格、库存索引）迁移后删除
+void BookSystem::migrateToBookIds(const std::string& baseFileName) {
+    std::vector<BookData> books;
+    isbnMap.forEach([&](const ISBNIndex&, const BookData& book) {
+        books.push_back(book);
+        books.back().setBookId(static_cast<int>(books.size()));
+    });
+
+    std::vector<std::pair<ISBNIndex, BookData>> isbnEntries;
+    isbnEntries.reserve(books.size());
+    for (const auto& book : books) {
+        isbnEntries.emplace_back(ISBNIndex(book.getISBN()), book);
+    }
+    isbnMap.clear();
+    isbnMap.bulkLoad(isbnEntries);
+    loadIndices(books);
+
+    const std::string oldSalesFile = baseFileName + "_sales";
+    if (std::ifstream(oldSalesFile).good()) {
+        std::vector<std::pair<ISBNIndex, SalesRecord>> oldSales;
+        {
+            Map<ISBNIndex, SalesRecord> oldSalesMap(oldSalesFile);
+            oldSalesMap.forEach([&](const ISBNIndex& isbn, const SalesRecord& sales) {
+                oldSales.emplace_back(isbn, sales);
+            });
+        }
+
+        // 两边都按 ISBN 有序，归并查出编号；编号也按 ISBN 顺序分配，salesEntries 天然有序
+        std::vector<std::pair<int, SalesRecord>> salesEntries;
+        std::vector<std::pair<long long, int>> rankEntries;
+        size_t pos = 0;
+        for (const auto& [isbn, sales] : oldSales) {
+            while (pos < books.size() && ISBNIndex(books[pos].getISBN()) < isbn) pos++;
+            if (pos < books.size() && ISBNIndex(books[pos].getISBN()) == isbn) {
+                salesEntries.emplace_back(books[pos].getBookId(), sales);
+                rankEntries.emplace_back(-sales.units, books[pos].getBookId());
+            }
+        }
+        std::sort(rankEntries.begin(), rankEntries.end());
+        salesMap.bulkLoad(salesEntries);
+        salesRank.bulkLoad(rankEntries);
+    }
+
+    for (const char* suffix : {"_name", "_author", "_keyword", "_price", "_stock", "_sales", "_sales_rank"}) {
+        std::remove((baseFileName + suffix).c_str());
+    }
+}
+
+// 为已编号的图书批量建立除 ISBN 表以外的索引
+void BookSystem::loadIndices(const std::vector<BookData>& books) {
+    std::vector<std::pair<int, ISBNIndex>> idEntries;
+    std::vector<std::pair<NameAuthorIndex, int>> nameEntries;
+    std::vector<std::pair<NameAuthorIndex, int>> authorEntries;
+    std::vector<std::pair<KeywordIndex, int>> keywordEntries;
+    std::vector<std::pair<double, int>> priceEntries;
+    std::vector<std::pair<long long, int>> stockEntries;
+    idEntries.reserve(books.size());
+
+    for (const auto& book : books) {
+        const int id = book.getBookId();
+        idEntries.emplace_back(id, ISBNIndex(book.getISBN()));
+        priceEntries.emplace_back(book.getPrice(), id);
+        stockEntries.emplace_back(book.getStock(), id);
+        if (!book.getBookName().empty()) {
+            nameEntries.emplace_back(NameAuthorIndex(book.getBookName()), id);
+        }
+        if (!book.getAuthor().empty()) {
+            authorEntries.emplace_back(NameAuthorIndex(book.getAuthor()), id);
+        }
+        for (const auto& keyword : book.getAllKeywords()) {
+            if (!keyword.empty()) {
+                keywordEntries.emplace_back(KeywordIndex(keyword), id);
+            }
+        }
+    }
+    std::sort(idEntries.begin(), idEntries.end());
+    std::sort(nameEntries.begin(), nameEntries.end());
+    std::sort(authorEntries.begin(), authorEntries.end());
+    std::sort(keywordEntries.begin(), keywordEntries.end());
+    std::sort(priceEntries.begin(), priceEntries.end());
+    std::sort(stockEntries.begin(), stockEntries.end());
+
+    idIndex.bulkLoad(idEntries);
+    nameIndex.bulkLoad(nameEntries);
+    authorIndex.bulkLoad(authorEntries);
+    keywordIndex.bulkLoad(keywordEntries);
+    priceIndex.bulkLoad(priceEntries);
+    stockIndex.bulkLoad(stockEntries);
+}
+
+// 编号只增不回收，下一个编号为已用的最大编号 + 1（编号表按编号有序）
+void BookSystem::updateNextBookId() {
+    nextBookId = 1;
+    idIndex.forEach([&](const int& id, const ISBNIndex&) { nextBookId = id + 1; });
+}
+
+// 按编号取图书，按 ISBN 顺序访问：编号、ISBN 各排一次序后分别在两张表上查。
+// 两张表都有哈希索引，书少时批量取，只读这些书所在的块（见 Map::forEachOf）
+template<typename Visitor>
+void BookSystem::forEachBookOf(std::vector<int> ids, Visitor visit) const {
+    if (ids.empty()) return;
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+    ArenaVector<ISBNIndex> isbns;
+    isbns.reserve(ids.size());
+    idIndex.forEachOf(ids, [&](const int&, const ISBNIndex& isbn) { isbns.push_back(isbn); });
+    if (isbns.empty()) return;
+
+    std::sort(isbns.begin(), isbns.end());
+    isbnMap.forEachOf(isbns, [&](const ISBNIndex&, const BookData& book) { visit(book); });
+}
+
+void BookSystem::updateStockIndex(int id, long long oldStock, long long newStock) {
+    stockIndex.remove(oldStock, id);
+    stockIndex.insert(newStock, id);
+}
 
 bool BookSystem::isValidISBNStr(const std::string& isbn) {
     std::string cleanIsbn = isbn;
@@ -194,7 +431,7 @@ bool BookSystem::isValidKeywordsStr(const std::string& keywords) const {    //
 
     if (keywords.find('\"') != std::string::npos) return false;
 
-    std::vector<std::string> kwList = splitKeywords(keywords);
+    ArenaVector<std::string> kwList = splitKeywords(keywords);
     if (kwList.empty()) return false;
 
     for (const auto& kw : kwList) {
@@ -295,8 +532,8 @@ bool BookSystem::isValidQuantityStr(const std::string& quantityStr) const {
 }
 
 
-std::vector<std::string> BookSystem::splitKeywords(const std::string& keywords) const {    //要求传入不带“” 的keyword
-    std::vector<std::string> result;
+ArenaVector<std::string> BookSystem::splitKeywords(const std::string& keywords) const {    //要求传入不带“” 的keyword
+    ArenaVector<std::string> result;
     if (keywords.empty()) return result;
 
     size_t start = 0;
@@ -323,90 +560,86 @@ std::vector<std::string> BookSystem::splitKeywords(const std::string& keywords)
 }
 
 void BookSystem::addToIndices(const BookData& book) {
-    const ISBNIndex isbn(book.getISBN());
+    const int id = book.getBookId();
     const NameAuthorIndex name(book.getBookName());
     NameAuthorIndex author(book.getAuthor());
-    std::vector<std::string> keywords = book.getAllKeywords();
+    ArenaVector<std::string> keywords = book.getAllKeywords();
+
+    queryCache.bumpIndex(QueryCache::NAME);
+    queryCache.bumpIndex(QueryCache::AUTHOR);
+    queryCache.bumpIndex(QueryCache::KEYWORD);
+
+    idIndex.insert(id, ISBNIndex(book.getISBN()));
+    priceIndex.insert(book.getPrice(), id);
+    stockIndex.insert(book.getStock(), id);
 
     if (!name.empty()) {
-        nameIndex.insert(name, isbn);
+        nameIndex.insert(name, id);
     }
 
     if (!author.empty()) {
-        authorIndex.insert(author, isbn);
+        authorIndex.insert(author, id);
     }
 
     for (const auto& keyword : keywords) {
         if (!keyword.empty()) {
             KeywordIndex kwIndex(keyword);
-            keywordIndex.insert(kwIndex, isbn);
+            keywordIndex.insert(kwIndex, id);
         }
     }
 }
 
 void BookSystem::removeFromIndices(const BookData& book) {
-    ISBNIndex isbn(book.getISBN());
+    const int id = book.getBookId();
     NameAuthorIndex name(book.getBookName());
     NameAuthorIndex author(book.getAuthor());
-    std::vector<std::string> keywords = book.getAllKeywords();
+    ArenaVector<std::string> keywords = book.getAllKeywords();
+
+    queryCache.bumpIndex(QueryCache::NAME);
+    queryCache.bumpIndex(QueryCache::AUTHOR);
+    queryCache.bumpIndex(QueryCache::KEYWORD);
+
+    idIndex.remove(id, ISBNIndex(book.getISBN()));
+    priceIndex.remove(book.getPrice(), id);
+    stockIndex.remove(book.getStock(), id);
 
     if (!name.empty()) {
-        std::vector<ISBNIndex> isbns = nameIndex.find(name);
-        for (const auto& storedIsbn : isbns) {
-            if (storedIsbn == isbn) {
-                nameIndex.remove(name, storedIsbn);
-            }
-        }
+        nameIndex.remove(name, id);
     }
 
     if (!author.empty()) {
-        std::vector<ISBNIndex> isbns = authorIndex.find(author);
-        for (const auto& storedIsbn : isbns) {
-            if (storedIsbn == isbn) {
-                authorIndex.remove(author, storedIsbn);
-            }
-        }
+        authorIndex.remove(author, id);
     }
 
     for (const auto& keyword : keywords) {
         if (!keyword.empty()) {
             KeywordIndex kwIndex(keyword);
-            std::vector<ISBNIndex> isbns = keywordIndex.find(kwIndex);
-            for (const auto& storedIsbn : isbns) {
-                if (storedIsbn == isbn) {
-                    keywordIndex.remove(kwIndex, storedIsbn);
-                }
-            }
+            keywordIndex.remove(kwIndex, id);
         }
     }
 }
 
 void BookSystem::updateIndices(const BookData& oldBook, const BookData& newBook) {
-ISBNIndex isbn(oldBook.getISBN());
+    const int id = oldBook.getBookId();
+    ISBNIndex isbn(oldBook.getISBN());
     ISBNIndex newIsbn(newBook.getISBN());
 
-    // ISBN改变
+    // ISBN改变：其余索引存的是编号，只需改编号 -> ISBN 这一条
     if (isbn != newIsbn) {
-        removeFromIndices(oldBook);
-        addToIndices(newBook);
-        return;
+        idIndex.remove(id, isbn);
+        idIndex.insert(id, newIsbn);
     }
 
     if (oldBook.getBookName() != newBook.getBookName()) {
         NameAuthorIndex oldName(oldBook.getBookName());
         NameAuthorIndex newName(newBook.getBookName());
+        queryCache.bumpIndex(QueryCache::NAME);
 
         if (!oldName.empty()) {
-            std::vector<ISBNIndex> isbns = nameIndex.find(oldName);
-            for (const auto& storedIsbn : isbns) {
-                if (storedIsbn == isbn) {
-                    nameIndex.remove(oldName, storedIsbn);
-                    break;
-                }
-            }
+            nameIndex.remove(oldName, id);
         }
         if (!newName.empty()) {
-            nameIndex.insert(newName, isbn);
+            nameIndex.insert(newName, id);
         }
     }
 
@@ -414,46 +647,43 @@ ISBNIndex isbn(oldBook.getISBN());
     if (oldBook.getAuthor() != newBook.getAuthor()) {
         NameAuthorIndex oldAuthor(oldBook.getAuthor());
         NameAuthorIndex newAuthor(newBook.getAuthor());
+        queryCache.bumpIndex(QueryCache::AUTHOR);
 
         if (!oldAuthor.empty()) {
-            std::vector<ISBNIndex> isbns = authorIndex.find(oldAuthor);
-            for (const auto& storedIsbn : isbns) {
-                if (storedIsbn == isbn) {
-                    authorIndex.remove(oldAuthor, storedIsbn);
-                    break;
-                }
-            }
+            authorIndex.remove(oldAuthor, id);
         }
 
         if (!newAuthor.empty()) {
-            authorIndex.insert(newAuthor, isbn);
+            authorIndex.insert(newAuthor, id);
         }
     }
 
-    std::vector<std::string> oldKeywords = oldBook.getAllKeywords();
-    std::vector<std::string> newKeywords = newBook.getAllKeywords();
+    if (oldBook.getPrice() != newBook.getPrice()) {
+        priceIndex.remove(oldBook.getPrice(), id);
+        priceIndex.insert(newBook.getPrice(), id);
+    }
+
+    ArenaVector<std::string> oldKeywords = oldBook.getAllKeywords();
+    ArenaVector<std::string> newKeywords = newBook.getAllKeywords();
 
-    std::unordered_set<std::string> oldSet(oldKeywords.begin(), oldKeywords.end());
-    std::unordered_set<std::string> newSet(newKeywords.begin(), newKeywords.end());
+    using KeywordSet = std::unordered_set<std::string, std::hash<std::string>, std::equal_to<std::string>,
+                                          ArenaAllocator<std::string>>;
+    KeywordSet oldSet(oldKeywords.begin(), oldKeywords.end());
+    KeywordSet newSet(newKeywords.begin(), newKeywords.end());
 
     if (oldSet != newSet) {
+        queryCache.bumpIndex(QueryCache::KEYWORD);
         for (const auto& keyword : oldKeywords) {
             if (newSet.find(keyword) == newSet.end()) {
                 KeywordIndex kwIndex(keyword);
-                std::vector<ISBNIndex> isbns = keywordIndex.find(kwIndex);
-                for (const auto& storedIsbn : isbns) {
-                    if (storedIsbn == isbn) {
-                        keywordIndex.remove(kwIndex, storedIsbn);
-                        break;
-                    }
-                }
+                keywordIndex.remove(kwIndex, id);
             }
         }
 
         for (const auto& keyword : newKeywords) {
             if (oldSet.find(keyword) == oldSet.end()) {
                 KeywordIndex kwIndex(keyword);
-                keywordIndex.insert(kwIndex, isbn);
+                keywordIndex.insert(kwIndex, id);
             }
         }
     }
@@ -466,48 +696,122 @@ std::vector<BookData> BookSystem::getAllBooksFromMap() const {
 }
 
 bool BookSystem::showBooks(const std::string& type, const std::string& value) {  //param_type  param_value
-    std::vector<BookData> results;
+    QueryCache::Filter filter;
 
     // for (auto i : value) {
     //     std::cerr << i << " ";
     // }
 
     if (type.empty()) {
-        results = getAllBooks();
+        // 全部图书：ISBN 链表本身有序，边读边输出
+        bool any = false;
+        isbnMap.forEach([&](const ISBNIndex&, const BookData& book) {
+            commandOutput() << book << "\n";
+            any = true;
+        });
+        if (!any) commandOutput() << "\n";
+        return true;
     } else if (type == "ISBN") {
         // exit(1);
         if (value.empty()) return false;  // ISBN不能为空
         if (!isValidISBNStr(value)) return false;  // ← 增加验证！
-        results = searchByISBN(value);
+        filter = QueryCache::ISBN;
     } else if (type == "name") {
         // exit(1);
         if (value.empty()) return false;  // 书名不能为空
         if (!isValidBookNameStr(value)) return false;
-        results = searchByName(value);
+        filter = QueryCache::NAME;
     } else if (type == "author") {
         if (value.empty()) return false;  // 作者不能为空
         if (!isValidAuthorStr(value)) return false;
-        results = searchByAuthor(value);
+        filter = QueryCache::AUTHOR;
     } else if (type == "keyword") {
         if (value.empty()) return false;  // 关键词不能为空
         // show命令只能接受单个关键词，不能包含|
         if (value.find('|') != std::string::npos) return false;
         // 验证关键词格式
         if (!isValidSingleKeywordStr(value)) return false;  // 需要添加这个函数
-        results = searchByKeyword(value);
+        filter = QueryCache::KEYWORD;
+    } else if (type == "price" || type == "stock") {
+        return showRange(type, value);
     } else {
         return false;
     }
 
+    // 事务内的查询看得到未提交的修改，不读也不写缓存
+    const bool cacheable = !currentTransaction;
+    std::shared_ptr<const std::string> cached;
+    if (cacheable && queryCache.lookup(filter, value, cached)) {
+        commandOutput() << *cached;
+        return true;
+    }
+    const QueryCache::Ticket ticket = queryCache.ticket(filter);
+
+    ArenaVector<BookData> results;
+    if (filter == QueryCache::ISBN) {
+        results = searchByISBN(value);
+    } else if (filter == QueryCache::NAME) {
+        results = searchByName(value);
+    } else if (filter == QueryCache::AUTHOR) {
+        results = searchByAuthor(value);
+    } else {
+        results = searchByKeyword(value);
+    }
+
     std::sort(results.begin(), results.end());   // 按ISBN排序
 
+    std::string rows;
+    std::vector<std::string> isbns;
     if (results.empty()) {
-        std::cout << "\n";
+        rows = "\n";
     } else {
         for (const auto& book : results) {
-            std::cout << book.toString() << "\n";
+            book.appendTo(rows);
+            rows += "\n";
+            isbns.push_back(book.getISBN());
+        }
+    }
+    commandOutput() << rows;
+    if (cacheable) {
+        queryCache.store(filter, value, ticket, std::move(rows), std::move(isbns));
+    }
+    return true;
+}
+
+// show -price=[lo,hi] / show -stock<=N：只扫描索引中落在区间内的键
+bool BookSystem::showRange(const std::string& type, const std::string& value) {
+    std::vector<int> ids;
+
+    if (type == "price") {
+        const size_t comma = value.find(',');
+        if (comma == std::string::npos) return false;
+        const std::string lowStr = value.substr(0, comma);
+        const std::string highStr = value.substr(comma + 1);
+        if (!isValidPriceStr(lowStr) || !isValidPriceStr(highStr)) return false;
+
+        const double low = std::stod(lowStr);
+        const double high = std::stod(highStr);
+        if (high < low) return false;
+        priceIndex.forEachInRange(low, high, [&](const double&, const int& id) {
+            ids.push_back(id);
+        });
+    } else {
+        if (value.length() > 10) return false;
+        for (char c : value) {
+            if (!isdigit(c)) return false;
         }
+        const long long limit = std::stoll(value);
+        stockIndex.forEachInRange(0LL, limit, [&](const long long&, const int& id) {
+            ids.push_back(id);
+        });
     }
+
+    bool any = false;
+    forEachBookOf(std::move(ids), [&](const BookData& book) {
+        commandOutput() << book << "\n";
+        any = true;
+    });
+    if (!any) commandOutput() << "\n";
     return true;
 }
 
@@ -533,39 +837,117 @@ bool BookSystem::buyBook(const std::string& isbnStr, long long quantity, double&
 
     total = book.getPrice() * quantity;
 
+    const long long oldStock = book.getStock();
     book.decreaseStock(quantity);
 
     ISBNIndex isbn(isbnStr);
     isbnMap.remove(isbn, book);
     isbnMap.insert(isbn, book);
+    updateStockIndex(book.getBookId(), oldStock, book.getStock());
+    queryCache.touchBook(isbnStr);
 
     addFinanceRecord(total, 0.0);
+    recordSale(book.getBookId(), quantity, total);
 
     return true;
 }
 
-bool BookSystem::selectBook(const std::string& isbnStr) {
+void BookSystem::recordSale(int id, long long quantity, double total) {
+    SalesRecord sales(quantity, total);
+    std::vector<SalesRecord> records = salesMap.find(id);
+    if (!records.empty()) {
+        const SalesRecord& old = records[0];
+        salesMap.remove(id, old);
+        salesRank.remove(-old.units, id);
+        sales.units += old.units;
+        sales.revenue += old.revenue;
+    }
+    salesMap.insert(id, sales);
+    salesRank.insert(-sales.units, id);
+}
+
+bool BookSystem::showBestsellers(int count) const {
+    std::vector<int> top;
+    if (count > 0) {
+        salesRank.forEachWhile([&](const long long&, const int& id) {
+            top.push_back(id);
+            return static_cast<int>(top.size()) < count;
+        });
+    }
+
+    if (top.empty()) {
+        commandOutput() << "\n";
+        return true;
+    }
+
+    // 榜上的书一次取齐：销量记录与图书各批量查一次，不再逐行查三张表
+    std::vector<int> ids(top);
+    std::sort(ids.begin(), ids.end());
+    ArenaVector<SalesRecord> sales(ids.size());
+    ArenaVector<char> hasSales(ids.size(), 0);
+    salesMap.forEachOf(ids, [&](const int& id, const SalesRecord& record) {
+        const size_t pos = std::lower_bound(ids.begin(), ids.end(), id) - ids.begin();
+        if (hasSales[pos]) return;     // 同一编号只取第一条，与 find 相同
+        sales[pos] = record;
+        hasSales[pos] = 1;
+    });
+    ArenaVector<BookData> books(ids.size());
+    forEachBookOf(ids, [&](const BookData& book) {
+        const size_t pos = std::lower_bound(ids.begin(), ids.end(), book.getBookId()) - ids.begin();
+        if (pos < ids.size() && ids[pos] == book.getBookId()) books[pos] = book;
+    });
+
+    for (const int id : top) {
+        const size_t pos = std::lower_bound(ids.begin(), ids.end(), id) - ids.begin();
+        if (!hasSales[pos] || !books[pos].isValid()) continue;
+        commandOutput() << books[pos].getISBN() << "\t"
+                  << books[pos].getBookName() << "\t"
+                  << sales[pos].units << "\t"
+                  << formatDouble(sales[pos].revenue) << "\n";
+    }
+    return true;
+}
+
+bool BookSystem::selectBook(const std::string& isbnStr, BookHandle& handle) {
     if (!isValidISBNStr(isbnStr)) return false;
 
     const ISBNIndex isbn(isbnStr);
+    BookData book;
 
-    if (!bookExists(isbn)) {
+    if (!isbnMap.locate(isbn, book, handle)) {
         BookData newBook(isbnStr);  // 创建只有ISBN的图书
+        newBook.setBookId(nextBookId++);
         isbnMap.insert(isbn, newBook);
+        addToIndices(newBook);
+        queryCache.bumpIndex(QueryCache::ISBN);
+        isbnMap.locate(isbn, book, handle);
         return true;  // 总是返回true，因为创建应该成功
     }
     return true;
 }
 
-bool BookSystem::modifyBook(const std::string& selectedISBN,
+// 读选中的图书：句柄有效时只读一个块，失效时按 ISBN 查找并更新句柄
+bool BookSystem::readSelected(const ISBNIndex& isbn, BookHandle& handle, BookData& book) const {
+    if (isbnMap.readAt(handle, isbn, book)) return true;
+    return isbnMap.locate(isbn, book, handle);
+}
+
+// 写回 ISBN 未变的选中图书：凭句柄原地改写，不行再删了重插
+void BookSystem::writeSelected(const ISBNIndex& isbn, const BookHandle& handle, const BookData& book) {
+    if (isbnMap.updateAt(handle, isbn, book)) return;
+    isbnMap.remove(isbn, book);
+    isbnMap.insert(isbn, book);
+}
+
+bool BookSystem::modifyBook(const std::string& selectedISBN, BookHandle& handle,
                            const std::vector<std::pair<std::string, std::string>>& modifications) {  //pair<std::string, std::string> param_type  param_value
     // std::cerr << selectedISBN << "  " << bookExistsStr(selectedISBN);
-    if (selectedISBN.empty() || !bookExistsStr(selectedISBN)) {
+    BookData originalBook;
+    if (selectedISBN.empty() || !readSelected(ISBNIndex(selectedISBN), handle, originalBook)) {
         // std::cerr << "  test3  \n";
         return false;
     }
 
-    BookData originalBook = getBookByISBNStr(selectedISBN);
     BookData modifiedBook = originalBook;
 
     std::string originalISBN = selectedISBN;
@@ -641,33 +1023,126 @@ bool BookSystem::modifyBook(const std::string& selectedISBN,
     if (isbnModified) {
         isbnMap.remove(oldIsbn, originalBook);
         isbnMap.insert(newIsbn, modifiedBook);
+        queryCache.bumpIndex(QueryCache::ISBN);
     } else {
-        isbnMap.remove(oldIsbn, originalBook);
-        isbnMap.insert(oldIsbn, modifiedBook);
+        writeSelected(oldIsbn, handle, modifiedBook);
     }
+    queryCache.touchBook(originalISBN);
 
     return true;
 }
 
-bool BookSystem::importBook(const std::string& selectedISBN, long long quantity, double totalCost) {
-    if (selectedISBN.empty() || !bookExistsStr(selectedISBN)) return false;
+bool BookSystem::importBook(const std::string& selectedISBN, BookHandle& handle, long long quantity, double totalCost) {
+    if (selectedISBN.empty()) return false;
     if (quantity <= 0 || totalCost <= 0) return false;
 
     // if (totalCost <= 0.0) return false;
 
-    BookData book = getBookByISBNStr(selectedISBN);
+    ISBNIndex isbn(selectedISBN);
+    BookData book;
+    if (!readSelected(isbn, handle, book)) return false;
 
+    const long long oldStock = book.getStock();
     book.increaseStock(quantity);
 
-    ISBNIndex isbn(selectedISBN);
-    isbnMap.remove(isbn, book);
-    isbnMap.insert(isbn, book);
+    writeSelected(isbn, handle, book);
+    updateStockIndex(book.getBookId(), oldStock, book.getStock());
+    queryCache.touchBook(selectedISBN);
 
     addFinanceRecord(0.0, totalCost);
 
     return true;
 }
 
+bool BookSystem::loadCatalog(const std::string& path) {
+    std::ifstream in(path);
+    if (!in.is_open()) return false;
+
+    // 先整体校验，任何一行不合法都不写入
+    std::vector<BookData> books;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) continue;
+
+        std::vector<std::string> fields = splitCatalogLine(line);
+        if (fields.size() != 5) return false;
+        const std::string& isbn = fields[0];
+        const std::string& name = fields[1];
+        const std::string& author = fields[2];
+        const std::string& keywords = fields[3];
+        const std::string& price = fields[4];
+
+        if (!isValidISBNStr(isbn)) return false;
+        if (!name.empty() && !isValidBookNameStr(name)) return false;
+        if (!author.empty() && !isValidAuthorStr(author)) return false;
+        if (!keywords.empty() && !isValidKeywordsStr(keywords)) return false;
+        if (!price.empty() && !isValidPriceStr(price)) return false;
+
+        books.emplace_back(isbn, name, author, keywords, price.empty() ? 0.0 : std::stod(price), 0);
+    }
+    if (books.empty()) return true;
+
+    // ISBN 在文件内重复或与已有图书重复时拒绝整个文件；已有图书按 ISBN 顺序归并比对
+    std::sort(books.begin(), books.end());
+    for (size_t i = 1; i < books.size(); i++) {
+        if (books[i] == books[i - 1]) return false;
+    }
+    bool duplicated = false;
+    size_t pos = 0;
+    isbnMap.forEachWhile([&](const ISBNIndex& isbn, const BookData&) {
+        while (pos < books.size() && ISBNIndex(books[pos].getISBN()) < isbn) pos++;
+        if (pos < books.size() && ISBNIndex(books[pos].getISBN()) == isbn) {
+            duplicated = true;
+        }
+        return !duplicated && pos < books.size();
+    });
+    if (duplicated) return false;
+
+    std::vector<std::pair<ISBNIndex, BookData>> isbnEntries;
+    isbnEntries.reserve(books.size());
+    for (auto& book : books) {
+        book.setBookId(nextBookId++);
+        isbnEntries.emplace_back(ISBNIndex(book.getISBN()), book);
+    }
+
+    isbnMap.bulkLoad(isbnEntries);
+    loadIndices(books);
+    queryCache.invalidateAll();
+    return true;
+}
+
+bool BookSystem::exportCatalog(const std::string& path, const std::string& order) const {
+    if (order != "ISBN" && order != "price" && order != "stock" && order != "name") return false;
+
+    std::ofstream out(path, std::ios::trunc);
+    if (!out.is_open()) return false;
+
+    // 同序的图书再按 ISBN 排，输出唯一确定
+    bool ok = true;
+    if (order == "ISBN") {
+        isbnMap.forEach([&](const ISBNIndex&, const BookData& book) { out << book << "\n"; });
+    } else if (order == "price") {
+        ok = writeSorted(isbnMap, out, [](const BookData& a, const BookData& b) {
+            if (a.getPrice() != b.getPrice()) return a.getPrice() < b.getPrice();
+            return a < b;
+        });
+    } else if (order == "stock") {
+        ok = writeSorted(isbnMap, out, [](const BookData& a, const BookData& b) {
+            if (a.getStock() != b.getStock()) return a.getStock() < b.getStock();
+            return a < b;
+        });
+    } else {
+        ok = writeSorted(isbnMap, out, [](const BookData& a, const BookData& b) {
+            const int cmp = strcmp(a.getBookName().c_str(), b.getBookName().c_str());
+            if (cmp != 0) return cmp < 0;
+            return a < b;
+        });
+    }
+    out.flush();
+    return ok && out.good();
+}
+
 BookData BookSystem::getBookByISBN(const ISBNIndex& isbn) {
     std::vector<BookData> books = isbnMap.find(isbn);
     if (!books.empty()) {
@@ -681,8 +1156,8 @@ BookData BookSystem::getBookByISBNStr(const std::string& isbnStr) {
     return getBookByISBN(isbn);
 }
 
-std::vector<BookData> BookSystem::searchByISBN(const std::string& isbnStr) {
-    std::vector<BookData> result;
+ArenaVector<BookData> BookSystem::searchByISBN(const std::string& isbnStr) {
+    ArenaVector<BookData> result;
     BookData book = getBookByISBNStr(isbnStr);
     if (book.isValid()) {
         result.push_back(book);
@@ -690,47 +1165,38 @@ std::vector<BookData> BookSystem::searchByISBN(const std::string& isbnStr) {
     return result;
 }
 
-std::vector<BookData> BookSystem::searchByName(const std::string& name) {
-    std::vector<BookData> result;
+ArenaVector<BookData> BookSystem::searchByName(const std::string& name) {
+    ArenaVector<BookData> result;
     NameAuthorIndex nameIdx(name);
-    std::vector<ISBNIndex> isbns = nameIndex.find(nameIdx);
-
-    for (const auto& isbn : isbns) {
-        BookData book = getBookByISBN(isbn);
+    forEachBookOf(nameIndex.find(nameIdx), [&](const BookData& book) {
         if (book.isValid() && book.getBookName() == name) {
             result.push_back(book);
         }
-    }
+    });
 
     return result;
 }
 
-std::vector<BookData> BookSystem::searchByAuthor(const std::string& author) {
-    std::vector<BookData> result;
+ArenaVector<BookData> BookSystem::searchByAuthor(const std::string& author) {
+    ArenaVector<BookData> result;
     NameAuthorIndex authorIdx(author);
-    std::vector<ISBNIndex> isbns = authorIndex.find(authorIdx);
-
-    for (const auto& isbn : isbns) {
-        BookData book = getBookByISBN(isbn);
+    forEachBookOf(authorIndex.find(authorIdx), [&](const BookData& book) {
         if (book.isValid() && book.getAuthor() == author) {
             result.push_back(book);
         }
-    }
+    });
 
     return result;
 }
 
-std::vector<BookData> BookSystem::searchByKeyword(const std::string& keyword) {
-    std::vector<BookData> result;
+ArenaVector<BookData> BookSystem::searchByKeyword(const std::string& keyword) {
+    ArenaVector<BookData> result;
     KeywordIndex kwIdx(keyword);
-    std::vector<ISBNIndex> isbns = keywordIndex.find(kwIdx);
-
-    for (const auto& isbn : isbns) {
-        BookData book = getBookByISBN(isbn);
+    forEachBookOf(keywordIndex.find(kwIdx), [&](const BookData& book) {
         if (book.isValid() && book.hasKeyword(keyword)) {
             result.push_back(book);
         }
-    }
+    });
     return result;
 }
 
@@ -742,7 +1208,10 @@ bool BookSystem::createBook(const ISBNIndex& isbn) {
     if (isbn.empty() || bookExists(isbn)) return false;
 
     BookData newBook(isbn.toString());
+    newBook.setBookId(nextBookId++);
     isbnMap.insert(isbn, newBook);
+    addToIndices(newBook);
+    queryCache.bumpIndex(QueryCache::ISBN);
 
     return true;
 }
@@ -764,24 +1233,78 @@ bool BookSystem::bookExistsStr(const std::string& isbnStr) {
 
 
 FinanceSystem::FinanceSystem(const std::string& baseFileName)
-    : financeMap(baseFileName + "_finance") {
-        std::vector<FinanceRecord> allRecords = financeMap.getAllValues();
-        transactionCount = allRecords.size();
+    : financeMap(baseFileName + "_finance"),
+      minuteRollup(baseFileName + "_finance_minute"),
+      hourRollup(baseFileName + "_finance_hour"),
+      dayRollup(baseFileName + "_finance_day") {
+        migrateFinanceMap(baseFileName + "_finance");
+        updateTransactionCount();
+}
+
+void FinanceSystem::migrateFinanceMap(const std::string& fileName) {
+    std::ifstream test(fileName, std::ios::binary);
+    if (!test.good()) return;
+    int header[3] = {0, 0, 0};
+    test.read(reinterpret_cast<char*>(header), sizeof(header));
+    test.close();
+
+    std::vector<std::pair<int, FinanceRecord>> entries;
+    if (header[2] == 0) {
+        // 最早的块格式：基线版本的记录没有交易时刻；之后一段时间记录有时刻，块格式还没变
+        if (!readLegacyFinance<LegacyFinanceRecord>(fileName, entries) &&
+            !readLegacyFinance<FinanceRecord>(fileName, entries)) {
+            std::cerr << fileName << ": unrecognised finance records, file left in place\n";
+            return;
+        }
+        std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) {
+            if (a.first != b.first) return a.first < b.first;
+            return a.second < b.second;
+        });
+    } else {
+        Map<int, FinanceRecord> oldMap(fileName);
+        oldMap.forEach([&](const int& id, const FinanceRecord& record) { entries.emplace_back(id, record); });
+    }
+
+    // 只有装进去的条数与旧文件对得上才删掉旧文件；否则留着它，下次启动再迁移。
+    // 上次迁移装好了却没来得及删旧文件时，存储里已有这些记录，不再重复装载
+    auto countLoaded = [this] {
+        size_t count = 0;
+        financeMap.forEach([&](const int&, const FinanceRecord&) { count++; });
+        return count;
+    };
+    if (countLoaded() == 0 && !financeMap.bulkLoad(entries)) {
+        std::cerr << fileName << ": failed to load finance records, file left in place\n";
+        return;
+    }
+    const size_t loaded = countLoaded();
+    if (loaded != entries.size()) {
+        std::cerr << fileName << ": loaded " << loaded << " of " << entries.size()
+                  << " finance records, file left in place\n";
+        return;
+    }
+    std::remove(fileName.c_str());
 }
 
 bool FinanceSystem::addFinanceRecord(double income, double expense) {
     if (income < 0 || expense < 0) return false;
-    FinanceRecord record(income, expense);
+    const long long now = time(nullptr);
+    FinanceRecord record(income, expense, now);
     int transactionId = transactionCount + 1;
     financeMap.insert(transactionId, record);
     transactionCount = transactionId;
+
+    const long long local = toLocalSeconds(now);
+    const FinanceBucket delta(income, expense, 1);
+    addToRollup(minuteRollup, local - local % MINUTE, delta);
+    addToRollup(hourRollup, local - local % HOUR, delta);
+    addToRollup(dayRollup, local - local % DAY, delta);
     return true;
 
 }
 
 bool FinanceSystem::showFinance(int count) const {
     if (count == 0) {
-        std::cout << "\n";
+        commandOutput() << "\n";
         return true;
     }
 
@@ -793,27 +1316,15 @@ bool FinanceSystem::showFinance(int count) const {
     double totalExpense = 0.0;
 
     if (count == -1) {
-        for (int i = 1; i <= transactionCount; i++) {
-            std::vector<FinanceRecord> records = financeMap.find(i);
-            if (!records.empty()) {
-                totalIncome += records[0].income;
-                totalExpense += records[0].expense;
-            }
-        }
+        sumRecords(1, transactionCount, totalIncome, totalExpense);
     } else {
         int start = transactionCount - count + 1;
         if (start < 1) start = 1;
 
-        for (int i = start; i <= transactionCount; i++) {
-            std::vector<FinanceRecord> records = financeMap.find(i);
-            if (!records.empty()) {
-                totalIncome += records[0].income;
-                totalExpense += records[0].expense;
-            }
-        }
+        sumRecords(start, transactionCount, totalIncome, totalExpense);
     }
 
-    std::cout << "+ " << formatDouble(totalIncome)
+    commandOutput() << "+ " << formatDouble(totalIncome)
               << " - " << formatDouble(totalExpense) << "\n";
 
     return true;
@@ -824,32 +1335,34 @@ std::pair<double, double> FinanceSystem::getFinanceSummary(int count) const {
     double totalExpense = 0.0;
 
     if (count == -1 || count >= transactionCount) {
-        for (int i = 1; i <= transactionCount; i++) {
-            std::vector<FinanceRecord> records = financeMap.find(i);
-            if (!records.empty()) {
-                totalIncome += records[0].income;
-                totalExpense += records[0].expense;
-            }
-        }
+        sumRecords(1, transactionCount, totalIncome, totalExpense);
     } else {
         int start = transactionCount - count + 1;
         if (start < 1) start = 1;
 
-        for (int i = start; i <= transactionCount; i++) {
-            std::vector<FinanceRecord> records = financeMap.find(i);
-            if (!records.empty()) {
-                totalIncome += records[0].income;
-                totalExpense += records[0].expense;
-            }
-        }
+        sumRecords(start, transactionCount, totalIncome, totalExpense);
     }
 
     return {totalIncome, totalExpense};
 }
 
+void FinanceSystem::sumRecords(int from, int to, double& income, double& expense) const {
+    // 一次顺序扫描代替逐个编号查找；同一编号只取第一条记录
+    bool seen = false;
+    int lastId = 0;
+    financeMap.forEachInRange(from, to, [&](const int& id, const FinanceRecord& record) {
+        if (seen && id == lastId) return;
+        income += record.income;
+        expense += record.expense;
+        seen = true;
+        lastId = id;
+    });
+}
+
 void FinanceSystem::updateTransactionCount() {
-    std::vector<FinanceRecord> allRecords = financeMap.getAllValues();
-    transactionCount = allRecords.size();
+    // 交易编号从 1 起连续分配，最大编号就是交易数
+    int lastId = 0;
+    transactionCount = financeMap.lastKey(lastId) ? lastId : 0;
 }
 
 std::string FinanceSystem::formatDouble(double value) {
@@ -858,3 +1371,149 @@ std::string FinanceSystem::formatDouble(double value) {
     std::string result = oss.str();
     return result;
 }
+
+
+void FinanceSystem::addToRollup(Map<long long, FinanceBucket>& rollup, long long bucketStart,
+                                const FinanceBucket& delta) {
+    FinanceBucket bucket = delta;
+    std::vector<FinanceBucket> buckets = rollup.find(bucketStart);
+    if (!buckets.empty()) bucket.add(buckets[0]);
+    // 先插新值再删旧值：桶所在的块不会先被删空、再在文件末尾另建一块
+    rollup.insert(bucketStart, bucket);
+    if (!buckets.empty()) rollup.remove(bucketStart, buckets[0]);
+}
+
+void FinanceSystem::sumRollup(const Map<long long, FinanceBucket>& rollup, long long from, long long to,
+                              FinanceBucket& total) {
+    if (from >= to) return;
+    rollup.forEachInRange(from, to - 1, [&](const long long&, const FinanceBucket& bucket) {
+        total.add(bucket);
+    });
+}
+
+const Map<long long, FinanceBucket>& FinanceSystem::rollupOf(long long span) const {
+    if (span == DAY) return dayRollup;
+    if (span == HOUR) return hourRollup;
+    return minuteRollup;
+}
+
+FinanceBucket FinanceSystem::getRangeSummary(long long from, long long to) const {
+    FinanceBucket total;
+    long long t = from;
+
+    // 头部零散分钟补齐到整点，零散小时补齐到零点
+    long long end = std::min(to, (t + HOUR - 1) / HOUR * HOUR);
+    sumRollup(minuteRollup, t, end, total);
+    t = std::max(t, end);
+
+    end = std::min(to, (t + DAY - 1) / DAY * DAY);
+    sumRollup(hourRollup, t, end, total);
+    t = std::max(t, end);
+
+    // 中间整天
+    end = to / DAY * DAY;
+    if (end > t) {
+        sumRollup(dayRollup, t, end, total);
+        t = end;
+    }
+
+    // 尾部整小时与零散分钟
+    end = to / HOUR * HOUR;
+    if (end > t) {
+        sumRollup(hourRollup, t, end, total);
+        t = end;
+    }
+    sumRollup(minuteRollup, t, to, total);
+
+    return total;
+}
+
+bool FinanceSystem::showFinanceRange(long long from, long long to, long long span) const {
+    if (from >= to) return false;
+
+    if (span == 0) {
+        FinanceBucket total = getRangeSummary(from, to);
+        commandOutput() << "+ " << formatDouble(total.income)
+                  << " - " << formatDouble(total.expense) << "\n";
+        return true;
+    }
+
+    // 逐桶列出时区间向外对齐到桶边界
+    const long long low = from - from % span;
+    const long long high = (to + span - 1) / span * span;
+    bool printed = false;
+    rollupOf(span).forEachInRange(low, high - 1, [&](const long long& start, const FinanceBucket& bucket) {
+        commandOutput() << formatTime(start, span)
+                  << " + " << formatDouble(bucket.income)
+                  << " - " << formatDouble(bucket.expense)
+                  << " " << bucket.count << "\n";
+        printed = true;
+    });
+    if (!printed) {
+        commandOutput() << "\n";
+    }
+    return true;
+}
+
+long long FinanceSystem::toLocalSeconds(long long unixTime) {
+    const time_t t = static_cast<time_t>(unixTime);
+    tm local{};
+    localtime_r(&t, &local);
+    return static_cast<long long>(timegm(&local));
+}
+
+bool FinanceSystem::parseTimeStr(const std::string& str, long long& start, long long& span) {
+    // YYYY-MM-DD[THH[:MM]]
+    if (str.length() != 10 && str.length() != 13 && str.length() != 16) return false;
+
+    for (size_t i = 0; i < str.length(); i++) {
+        const char c = str[i];
+        if (i == 4 || i == 7) {
+            if (c != '-') return false;
+        } else if (i == 10) {
+            if (c != 'T') return false;
+        } else if (i == 13) {
+            if (c != ':') return false;
+        } else if (!isdigit(static_cast<unsigned char>(c))) {
+            return false;
+        }
+    }
+
+    tm fields{};
+    fields.tm_year = std::stoi(str.substr(0, 4)) - 1900;
+    fields.tm_mon = std::stoi(str.substr(5, 2)) - 1;
+    fields.tm_mday = std::stoi(str.substr(8, 2));
+    span = DAY;
+    if (str.length() >= 13) {
+        fields.tm_hour = std::stoi(str.substr(11, 2));
+        span = HOUR;
+    }
+    if (str.length() == 16) {
+        fields.tm_min = std::stoi(str.substr(14, 2));
+        span = MINUTE;
+    }
+
+    const int year = fields.tm_year, month = fields.tm_mon, day = fields.tm_mday;
+    const int hour = fields.tm_hour, minute = fields.tm_min;
+    start = static_cast<long long>(timegm(&fields));
+
+    // timegm 会把越界字段进位（如 02-30），进位了就说明输入非法
+    return fields.tm_year == year && fields.tm_mon == month && fields.tm_mday == day &&
+           fields.tm_hour == hour && fields.tm_min == minute;
+}
+
+std::string FinanceSystem::formatTime(long long localSeconds, long long span) {
+    const time_t t = static_cast<time_t>(localSeconds);
+    tm fields{};
+    gmtime_r(&t, &fields);
+
+    char buffer[32];
+    if (span == DAY) {
+        strftime(buffer, sizeof(buffer), "%Y-%m-%d", &fields);
+    } else if (span == HOUR) {
+        strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H", &fields);
+    } else {
+        strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M", &fields);
+    }
+    return buffer;
+}
\ No newline at end of file
@@ -6,33 +6,32 @@ Bookstore::Bookstore() : accountSystem("account_data"),bookSystem("book_data") {
 
 Bookstore::~Bookstore() = default;
 
-std::vector<std::string> Bookstore::tokenize(const std::string& input) {
-    std::vector<std::string> tokens;
-    std::string tmp = "";
+Tokens Bookstore::tokenize(const std::string& input) {
+    // 每个词都是原文中连续的一段，直接记下起点与长度，不复制
+    Tokens tokens;
     bool inQuotes = false;
-    
-    for (char c : input) {
+    size_t start = 0;
+
+    for (size_t i = 0; i < input.size(); i++) {
+        const char c = input[i];
         if (c == '\"') {
             inQuotes = !inQuotes;
-            tmp += c;
         } else if (c == ' ' && !inQuotes) {
-            if (!tmp.empty()) {
-                tokens.push_back(tmp);
-                tmp.clear();
+            if (i > start) {
+                tokens.emplace_back(input.data() + start, i - start);
             }
-        } else {
-            tmp += c;
+            start = i + 1;
         }
     }
-    
-    if (!tmp.empty()) {
-        tokens.push_back(tmp);
+
+    if (input.size() > start) {
+        tokens.emplace_back(input.data() + start, input.size() - start);
     }
-    
+
     return tokens;
 }
 
-bool Bookstore::parseShowCommand(const std::vector<std::string>& tokens, 
+bool Bookstore::parseShowCommand(const Tokens& tokens, 
                                 std::string& type, std::string& value) {
     if (tokens.size() == 1) {
         type = "";
@@ -46,23 +45,32 @@ bool Bookstore::parseShowCommand(const std::vector<std::string>& tokens,
 
     if (tokens.size() != 2) return false;
     
-    std::string param = tokens[1];
+    const std::string_view param = tokens[1];
     
     if (param.find("-ISBN=") == 0) {
         type = "ISBN";
-        value = param.substr(6);
+        value = std::string(param.substr(6));
         if (value.empty()) return false;
     } else if (param.find("-name=\"") == 0 && param.back() == '\"') {
         type = "name";
-        value = param.substr(7, param.length() - 8); // 移除-name="和结尾的"
+        value = std::string(param.substr(7, param.length() - 8)); // 移除-name="和结尾的"
         if (value.empty()) return false;
     } else if (param.find("-author=\"") == 0 && param.back() == '\"') {
         type = "author";
-        value = param.substr(9, param.length() - 10);
+        value = std::string(param.substr(9, param.length() - 10));
+        if (value.empty()) return false;
+    } else if (param.find("-price=[") == 0 && param.back() == ']') {
+        // -price=[lo,hi]，校验交给 BookSystem
+        type = "price";
+        value = std::string(param.substr(8, param.length() - 9));
+        if (value.empty()) return false;
+    } else if (param.find("-stock<=") == 0) {
+        type = "stock";
+        value = std::string(param.substr(8));
         if (value.empty()) return false;
     } else if (param.find("-keyword=\"") == 0 && param.back() == '\"') {
         type = "keyword";
-        value = param.substr(10, param.length() - 11);
+        value = std::string(param.substr(10, param.length() - 11));
         if (value.empty()) return false;
         if (value.find('|') != std::string::npos) return false;    // 检查是否为单个关键词
     } else {
@@ -72,23 +80,23 @@ bool Bookstore::parseShowCommand(const std::vector<std::string>& tokens,
     return true;
 }
 
-bool Bookstore::parseModifyCommand(const std::vector<std::string>& tokens,
+bool Bookstore::parseModifyCommand(const Tokens& tokens,
                                   std::vector<std::pair<std::string, std::string>>& modifications) {
     if (tokens.size() < 2) return false;
     
     for (size_t i = 1; i < tokens.size(); i++) {
-        std::string param = tokens[i];
+        const std::string_view param = tokens[i];
         
         if (param.find("-ISBN=") == 0) {
-            modifications.emplace_back("ISBN", param.substr(6));
+            modifications.emplace_back("ISBN", std::string(param.substr(6)));
         } else if (param.find("-name=\"") == 0 && param.back() == '\"') {
-            modifications.emplace_back("name", param.substr(7, param.length() - 8));
+            modifications.emplace_back("name", std::string(param.substr(7, param.length() - 8)));
         } else if (param.find("-author=\"") == 0 && param.back() == '\"') {
-            modifications.emplace_back("author", param.substr(9, param.length() - 10));
+            modifications.emplace_back("author", std::string(param.substr(9, param.length() - 10)));
         } else if (param.find("-keyword=\"") == 0 && param.back() == '\"') {
-            modifications.emplace_back("keyword", param.substr(10, param.length() - 11));
+            modifications.emplace_back("keyword", std::string(param.substr(10, param.length() - 11)));
         } else if (param.find("-price=") == 0) {
-            modifications.emplace_back("price", param.substr(7));
+            modifications.emplace_back("price", std::string(param.substr(7)));
         } else {
             return false;
         }
@@ -97,11 +105,11 @@ bool Bookstore::parseModifyCommand(const std::vector<std::string>& tokens,
     return true;
 }
 
-    bool Bookstore::checkCommandPrivilege(const std::vector<std::string>& tokens, int& requiredPrivilege) {
+    bool Bookstore::checkCommandPrivilege(const Tokens& tokens, int& requiredPrivilege) {
     if (tokens.empty()) return false;
 
-    const std::string command = tokens[0];
-    const std::string subcommand = tokens.size() >= 2 ? tokens[1] : "";
+    const std::string_view command = tokens[0];
+    const std::string_view subcommand = tokens.size() >= 2 ? tokens[1] : std::string_view();
 
     if (command == "su" || command == "register") {
         requiredPrivilege = 0;
@@ -113,12 +121,16 @@ bool Bookstore::parseModifyCommand(const std::vector<std::string>& tokens,
         // exit(1);
         if (subcommand == "finance") {
             requiredPrivilege = 7;
+        } else if (subcommand == "bestsellers") {
+            requiredPrivilege = 3;
         } else {
             requiredPrivilege = 1;  // 普通show命令
         }
     }
     else if (command == "useradd" || command == "select" ||
-              command == "modify" || command == "import") {
+              command == "modify" || command == "import" || command == "load" ||
+              command == "export" ||
+              command == "begin" || command == "commit" || command == "rollback") {
         requiredPrivilege = 3;
               }
     else if (command == "delete" || command == "log" ||
@@ -137,51 +149,184 @@ void Bookstore::run() {
 
     // 使用 while(getline(cin, line)) 可以自动检测 EOF
     while (std::getline(std::cin, line)) {
-        if (line.empty()) continue;
+        if (!executeLine(line)) break;
+    }
+}
 
-        std::vector<std::string> tokens = tokenize(line);
-        if (tokens.empty()) continue;
+bool Bookstore::executeLine(const std::string& line) {
+    if (line.empty()) return true;
 
-        std::string command = tokens[0];
+    // 本条指令的临时对象都从区域分配，指令结束时一并丢弃（见 arena.h）
+    CommandArena arena;
+    Tokens tokens = tokenize(line);
+    if (tokens.empty()) return true;
 
-        if (command == "quit" || command == "exit") {
-            if (tokens.size() != 1) {
-                std::cout << "Invalid" << std::endl;
-            } else {
-                break;
-            }
-            continue;
-        }
+    const std::string_view command = tokens[0];
 
-        // 检查权限
-        int requiredPrivilege = 0;
-        if (!checkCommandPrivilege(tokens, requiredPrivilege)) {
-            std::cout << "Invalid" << std::endl;
-            continue;
+    if (command == "quit" || command == "exit") {
+        if (tokens.size() != 1) {
+            commandOutput() << "Invalid" << std::endl;
+            return true;
         }
+        return false;
+    }
+
+    // 检查权限
+    int requiredPrivilege = 0;
+    if (!checkCommandPrivilege(tokens, requiredPrivilege)) {
+        commandOutput() << "Invalid" << std::endl;
+        return true;
+    }
+
+    if (!accountSystem.hasPrivilege(requiredPrivilege)) {
+        commandOutput() << "Invalid" << std::endl;
+        return true;
+    }
+
+    LoginStack* session = accountSystem.currentStack();
+    bool inTransaction;
+    {
+        std::lock_guard<std::mutex> guard(transactionMutex);
+        inTransaction = transactionOwner == session;
+    }
 
-        if (!accountSystem.hasPrivilege(requiredPrivilege)) {
-            std::cout << "Invalid" << std::endl;
-            continue;
+    // 报表与图书查询在读快照上执行，不等待也不阻塞修改数据的指令；
+    // 其余只读指令之间可以并行，修改数据的指令独占执行。
+    // 事务内的指令都独占执行，读写落在事务的脏块表上；
+    // 其他会话有未提交的事务时，除快照指令外都等它提交或回滚后再执行
+    // 常驻内存模式下修改数据的指令的写入到结束时才写进日志，且须在放开指令闩之前：
+    // 放开之后下一条修改数据的指令可能已经写了一半
+    bool success;
+    if (inTransaction) {
+        std::unique_lock<std::shared_mutex> lock(commandLatch);
+        if (command == "commit" || command == "rollback") {
+            WriteScope write;
+            success = processCommand(tokens);
+        } else {
+            TransactionScope transaction;
+            success = processCommand(tokens);
         }
+        if (memoryResident) ResidentFile::flushAll();
+    } else if (isSnapshotCommand(tokens)) {
+        SnapshotScope snapshot;
+        success = processCommand(tokens);
+    } else if (isReadOnlyCommand(tokens)) {
+        std::shared_lock<std::shared_mutex> lock(commandLatch, std::defer_lock);
+        lockOutsideTransaction(session, lock);
+        success = processCommand(tokens);
+    } else {
+        std::unique_lock<std::shared_mutex> lock(commandLatch, std::defer_lock);
+        lockOutsideTransaction(session, lock);
+        WriteScope write;
+        success = processCommand(tokens);
+        if (memoryResident) ResidentFile::flushAll();
+    }
+
+    if (!success) {
+        commandOutput() << "Invalid\n";
+    }
+    return true;
+}
 
-        if (!processCommand(tokens)) {
-            std::cout << "Invalid\n";
+bool Bookstore::isSnapshotCommand(const Tokens& tokens) {
+    const std::string_view command = tokens[0];
+    // show finance 读的是内存中的交易计数，仍走共享闩
+    return command == "report" || command == "log" || command == "export" ||
+           (command == "show" && (tokens.size() < 2 || tokens[1] != "finance"));
+}
+
+bool Bookstore::isReadOnlyCommand(const Tokens& tokens) {
+    const std::string_view command = tokens[0];
+    // su/logout 只改动本会话的登录栈
+    return command == "show" || command == "report" || command == "log" ||
+           command == "su" || command == "logout";
+}
+
+bool Bookstore::otherTransactionOpen(LoginStack* session) {
+    std::lock_guard<std::mutex> guard(transactionMutex);
+    return transactionOwner != nullptr && transactionOwner != session;
+}
+
+// 等到没有其他会话的事务时加上指令闩。事务的指令之间不持闩，等到之后、加上闩之前
+// 可能又有会话开了事务，所以加闩后再看一次
+template<typename Lock>
+void Bookstore::lockOutsideTransaction(LoginStack* session, Lock& lock) {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(transactionMutex);
+            if (transactionOwner != nullptr && transactionOwner != session) {
+                transactionWaiters++;
+                if (waitHook) waitHook();
+                transactionEnded.wait(guard, [&] {
+                    return transactionsStopped || transactionOwner == nullptr || transactionOwner == session;
+                });
+                transactionWaiters--;
+            }
         }
+        lock.lock();
+        if (!otherTransactionOpen(session)) return;
+        lock.unlock();
+    }
+}
+
+// 调用者需独占指令闩并持有 transactionMutex
+void Bookstore::rollbackTransaction() {
+    TransactionManager::discardAll();
+    bookSystem.reloadAfterRollback();
+    for (auto it = transactionRenames.rbegin(); it != transactionRenames.rend(); ++it) {
+        accountSystem.updateSelectedISBNForAll(it->second, it->first);
+    }
+    transactionRenames.clear();
+    transactionOwner = nullptr;
+    transactionEnded.notify_all();
+}
+
+void Bookstore::openSession(LoginStack* stack) {
+    accountSystem.attachSession(stack);
+}
+
+void Bookstore::closeSession(LoginStack* stack) {
+    // 断开时未提交的事务一律回滚。只有该会话自己会改 transactionOwner 为它，先看一眼再加闩
+    bool inTransaction;
+    {
+        std::lock_guard<std::mutex> guard(transactionMutex);
+        inTransaction = transactionOwner == stack;
+    }
+    if (inTransaction) {
+        std::unique_lock<std::shared_mutex> lock(commandLatch);
+        std::lock_guard<std::mutex> guard(transactionMutex);
+        rollbackTransaction();
     }
+    accountSystem.detachSession(stack);
+}
+
+void Bookstore::switchSession(LoginStack* stack) {
+    accountSystem.switchSession(stack);
+}
+
+void Bookstore::setWaitHook(std::function<void()> hook) {
+    waitHook = std::move(hook);
+}
+
+void Bookstore::stopTransactions() {
+    std::unique_lock<std::shared_mutex> lock(commandLatch);
+    std::lock_guard<std::mutex> guard(transactionMutex);
+    transactionsStopped = true;
+    if (transactionOwner != nullptr) rollbackTransaction();
+    transactionEnded.notify_all();
 }
 
-bool Bookstore::processCommand(const std::vector<std::string>& tokens) {
+bool Bookstore::processCommand(const Tokens& tokens) {
     if (tokens.empty()) return true;
     
-    std::string command = tokens[0];
-    std::string command_ = "";
+    const std::string_view command = tokens[0];
+    std::string_view command_;
     if (tokens.size() >= 2) {
         command_ = tokens[1];
     }
 
     if (command != "log" && command != "report") {
-        std::string logDetails;
+        ArenaString logDetails;
         for (size_t i = 0; i < tokens.size(); i++) {
             if (i > 0) logDetails += " ";
             if (command == "passwd" && (i == 2 || i == 3)) {
@@ -199,29 +344,32 @@ bool Bookstore::processCommand(const std::vector<std::string>& tokens) {
         command == "passwd" || command == "useradd" || command == "delete") {
         return handleAccountCommand(tokens);
     } else if ((command == "show" && command_ != "finance" )|| command == "buy" || command == "select" ||
-               command == "modify" || command == "import") {
+               command == "modify" || command == "import" || command == "load" ||
+               command == "export") {
         // std::cerr << "test3" << handleBookCommand(tokens) << std::endl;
         return handleBookCommand(tokens);
     } else if (command == "show" && command_ == "finance") {
         return handleFinanceCommand(tokens);
     }else if (command == "report" || command == "log") {
         return handleLogCommand(tokens);
+    } else if (command == "begin" || command == "commit" || command == "rollback") {
+        return handleTransactionCommand(tokens);
     }
     
     return false;
 }
 
-bool Bookstore::handleAccountCommand(const std::vector<std::string>& tokens) {
-    std::string command = tokens[0];
+bool Bookstore::handleAccountCommand(const Tokens& tokens) {
+    const std::string_view command = tokens[0];
     
     try {
         if (command == "su") {
             // exit(1);
             if (tokens.size() == 2) {
                 string tmp = "";
-                return accountSystem.login(tokens[1], tmp);
+                return accountSystem.login(std::string(tokens[1]), tmp);
             } else if (tokens.size() == 3) {
-                return accountSystem.login(tokens[1], tokens[2]);
+                return accountSystem.login(std::string(tokens[1]), std::string(tokens[2]));
             }
         } else if (command == "logout") {
             // exit(1);
@@ -230,19 +378,21 @@ bool Bookstore::handleAccountCommand(const std::vector<std::string>& tokens) {
         } else if (command == "register") {
             // exit(1);
             if (tokens.size() != 4) return false;
-            return accountSystem.registerUser(tokens[1], tokens[2], tokens[3]);
+            return accountSystem.registerUser(std::string(tokens[1]), std::string(tokens[2]),
+                                              std::string(tokens[3]));
         } else if (command == "passwd") {
             // exit(1);
             if (tokens.size() == 3) {
-                return accountSystem.changePassword(tokens[1], "", tokens[2]);
+                return accountSystem.changePassword(std::string(tokens[1]), "", std::string(tokens[2]));
             } else if (tokens.size() == 4) {
-                return accountSystem.changePassword(tokens[1], tokens[2], tokens[3]);
+                return accountSystem.changePassword(std::string(tokens[1]), std::string(tokens[2]),
+                                                    std::string(tokens[3]));
             }
         }     else if (command == "useradd") {
             // exit(1);
             if (tokens.size() != 5) return false;
             // 检查privilege字符串是否合法
-            const std::string& privilegeStr = tokens[3];
+            const std::string_view privilegeStr = tokens[3];
 
             // 检查长度
             if (privilegeStr.length() != 1) return false;
@@ -253,12 +403,13 @@ bool Bookstore::handleAccountCommand(const std::vector<std::string>& tokens) {
             char c = privilegeStr[0];
             if (c != '0' && c != '1' && c != '3' && c != '7') return false;
 
-            int privilege = std::stoi(privilegeStr);
-            return accountSystem.addUser(tokens[1], tokens[2], privilege, tokens[4]);
+            int privilege = c - '0';
+            return accountSystem.addUser(std::string(tokens[1]), std::string(tokens[2]), privilege,
+                                         std::string(tokens[4]));
         } else if (command == "delete") {
             // exit(1);
             if (tokens.size() != 2) return false;
-            return accountSystem.deleteUser(tokens[1]);
+            return accountSystem.deleteUser(std::string(tokens[1]));
         }
     } catch (...) {
         return false;
@@ -267,13 +418,26 @@ bool Bookstore::handleAccountCommand(const std::vector<std::string>& tokens) {
     return false;
 }
 
-bool Bookstore::handleBookCommand(const std::vector<std::string>& tokens) {
-    std::string command = tokens[0];
+bool Bookstore::handleBookCommand(const Tokens& tokens) {
+    const std::string_view command = tokens[0];
     // for (auto i : tokens) {
     //     std::cerr << i << " ";
     // }
     try {
-        if (command == "show") {
+        if (command == "show" && tokens.size() >= 2 && tokens[1] == "bestsellers") {
+            // show bestsellers [Count]
+            if (tokens.size() != 3) return false;
+            const std::string countStr(tokens[2]);
+            if (countStr.empty() || countStr.length() > 10) return false;
+            for (char c : countStr) {
+                if (!isdigit(c)) return false;
+            }
+            if (countStr.length() > 1 && countStr[0] == '0') return false;
+
+            const long long count = std::stoll(countStr);
+            if (count > 2147483647LL) return false;
+            return bookSystem.showBestsellers(static_cast<int>(count));
+        } else if (command == "show") {
             // exit(1);
             std::string type, value;
             if (!parseShowCommand(tokens, type, value)) return false;
@@ -281,8 +445,8 @@ bool Bookstore::handleBookCommand(const std::vector<std::string>& tokens) {
         } else if (command == "buy") {
             if (tokens.size() != 3) return false;
 
-            const std::string& isbn = tokens[1];
-            const std::string& quantityStr = tokens[2];
+            const std::string isbn(tokens[1]);
+            const std::string quantityStr(tokens[2]);
 
             if (!bookSystem.isValidISBNStr(isbn)) {
                 return false;
@@ -297,7 +461,7 @@ bool Bookstore::handleBookCommand(const std::vector<std::string>& tokens) {
                 double total = 0.0;
                 bool success = bookSystem.buyBook(isbn, quantity, total);
                 if (success) {
-                    std::cout << std::fixed << std::setprecision(2) << total << "\n";
+                    commandOutput() << std::fixed << std::setprecision(2) << total << "\n";
                 }
                 return success;
             } catch (...) {
@@ -310,7 +474,7 @@ bool Bookstore::handleBookCommand(const std::vector<std::string>& tokens) {
                 return false;
             }
 
-            const std::string& isbn = tokens[1];
+            const std::string isbn(tokens[1]);
 
             // std::cerr << isbn.empty();
             // 检查ISBN是否为空
@@ -321,10 +485,11 @@ bool Bookstore::handleBookCommand(const std::vector<std::string>& tokens) {
             if (!bookSystem.isValidISBNStr(isbn)) {
                 return false;
             }
-            // 调用BookSystem的selectBook
-            bool success = bookSystem.selectBook(isbn);
+            // 调用BookSystem的selectBook，记下图书的句柄
+            BookHandle handle;
+            bool success = bookSystem.selectBook(isbn, handle);
             if (success) {
-                accountSystem.selectBook(isbn);
+                accountSystem.selectBook(isbn, handle);
             }
             return success;
         } else if (command == "modify") {
@@ -343,11 +508,17 @@ bool Bookstore::handleBookCommand(const std::vector<std::string>& tokens) {
                 }
             }
 
-            bool success = bookSystem.modifyBook(selected_ISBN, modifications);
+            BookHandle handle = accountSystem.getSelectedHandle();
+            bool success = bookSystem.modifyBook(selected_ISBN, handle, modifications);
+            accountSystem.setSelectedHandle(handle);
 
             // 如果修改成功且ISBN被修改，更新所有登录用户的selectedISBN
             if (success && selected_ISBN != new_ISBN) {
                 accountSystem.updateSelectedISBNForAll(selected_ISBN, new_ISBN);
+                std::lock_guard<std::mutex> guard(transactionMutex);
+                if (transactionOwner == accountSystem.currentStack()) {
+                    transactionRenames.emplace_back(selected_ISBN, new_ISBN);
+                }
             }
 
             return success;
@@ -355,8 +526,8 @@ bool Bookstore::handleBookCommand(const std::vector<std::string>& tokens) {
             // exit(1);
             if (tokens.size() != 3) return false;
 
-            std::string quantityStr = tokens[1];
-            std::string totalCostStr = tokens[2];
+            const std::string quantityStr(tokens[1]);
+            const std::string totalCostStr(tokens[2]);
 
             // 检查是否选中图书
             std::string selected_ISBN = accountSystem.getSelectedISBN();
@@ -377,10 +548,26 @@ bool Bookstore::handleBookCommand(const std::vector<std::string>& tokens) {
             try {
                 long long quantity = std::stoll(quantityStr);
                 double totalCost = std::stod(totalCostStr);
-                return bookSystem.importBook(selected_ISBN, quantity, totalCost);
+                BookHandle handle = accountSystem.getSelectedHandle();
+                const bool success = bookSystem.importBook(selected_ISBN, handle, quantity, totalCost);
+                accountSystem.setSelectedHandle(handle);
+                return success;
             } catch (...) {
                 return false;
             }
+        } else if (command == "load") {
+            // load [FilePath]：批量导入图书目录
+            if (tokens.size() != 2) return false;
+            return bookSystem.loadCatalog(std::string(tokens[1]));
+        } else if (command == "export") {
+            // export [FilePath] (-by=ISBN|price|stock|name)?
+            if (tokens.size() != 2 && tokens.size() != 3) return false;
+            std::string order = "ISBN";
+            if (tokens.size() == 3) {
+                if (tokens[2].find("-by=") != 0) return false;
+                order = std::string(tokens[2].substr(4));
+            }
+            return bookSystem.exportCatalog(std::string(tokens[1]), order);
         }
     } catch (...) {
         return false;
@@ -389,13 +576,13 @@ bool Bookstore::handleBookCommand(const std::vector<std::string>& tokens) {
     return false;
 }
 
-bool Bookstore::handleFinanceCommand(const std::vector<std::string>& tokens) {
+bool Bookstore::handleFinanceCommand(const Tokens& tokens) {
     // std::cerr << "test3 ";
     if (tokens[0] != "show" || tokens.size() < 2) {
         return false;
     }
 
-    std::string subcommand = tokens[1];
+    const std::string_view subcommand = tokens[1];
     if (subcommand != "finance") {
         return false;
     }
@@ -403,9 +590,12 @@ bool Bookstore::handleFinanceCommand(const std::vector<std::string>& tokens) {
     if (tokens.size() == 2) {
         // show finance（无参数）
         return bookSystem.showFinance(-1);
+    } else if (tokens[2].find('-') == 0) {
+        // show finance -from=[Time] -to=[Time] (-by=day|hour|minute)?
+        return handleFinanceRangeCommand(tokens);
     } else if (tokens.size() == 3) {
         // show finance [Count]
-        const std::string& countStr = tokens[2];
+        const std::string countStr(tokens[2]);
 
         // 检查是否为空
         if (countStr.empty()) return false;
@@ -432,29 +622,52 @@ bool Bookstore::handleFinanceCommand(const std::vector<std::string>& tokens) {
     return false;
 }
 
-bool Bookstore::handleLogCommand(const std::vector<std::string>& tokens) {
+bool Bookstore::handleFinanceRangeCommand(const Tokens& tokens) {
+    std::string fromStr, toStr, byStr;
+
+    for (size_t i = 2; i < tokens.size(); i++) {
+        const std::string_view param = tokens[i];
+        if (param.find("-from=") == 0 && fromStr.empty()) {
+            fromStr = std::string(param.substr(6));
+        } else if (param.find("-to=") == 0 && toStr.empty()) {
+            toStr = std::string(param.substr(4));
+        } else if (param.find("-by=") == 0 && byStr.empty()) {
+            byStr = std::string(param.substr(4));
+        } else {
+            return false;
+        }
+    }
+
+    long long from = 0, fromSpan = 0, to = 0, toSpan = 0;
+    if (!FinanceSystem::parseTimeStr(fromStr, from, fromSpan)) return false;
+    if (!FinanceSystem::parseTimeStr(toStr, to, toSpan)) return false;
+
+    long long span = 0;
+    if (byStr == "day") {
+        span = FinanceSystem::DAY;
+    } else if (byStr == "hour") {
+        span = FinanceSystem::HOUR;
+    } else if (byStr == "minute") {
+        span = FinanceSystem::MINUTE;
+    } else if (!byStr.empty()) {
+        return false;
+    }
+
+    // -to 按其精度取整个时间段，例如 -to=2025-12-31 包含当天
+    return bookSystem.showFinanceRange(from, to + toSpan, span);
+}
+
+bool Bookstore::handleLogCommand(const Tokens& tokens) {
     if (tokens.empty()) return false;
 
-    std::string command = tokens[0];
+    const std::string_view command = tokens[0];
 
     try {
         if (command == "report") {
             if (tokens.size() != 2) return false;
 
             if (tokens[1] == "finance") {
-                std::vector<std::pair<double, double>> financeData;
-
-                financeData = bookSystem.getAllFinanceRecords();
-
-                if (financeData.empty()) {
-                    auto summary = bookSystem.getFinanceSummary(-1);
-                    if (summary.first > 0 || summary.second > 0) {
-                        financeData.push_back(summary);
-                    }
-                }
-
-                std::string report = logSystem.generateFinanceReport(financeData);
-                std::cout << report;
+                logSystem.streamFinanceReport(commandOutput(), bookSystem.getFinanceSystem());
                 return true;
 
             } else if (tokens[1] == "employee") {
@@ -462,7 +675,7 @@ bool Bookstore::handleLogCommand(const std::vector<std::string>& tokens) {
                 logSystem.collectEmployeeRecordsFromLogs();
 
                 std::string report = logSystem.generateEmployeeReport();
-                std::cout << report;
+                commandOutput() << report;
                 return true;
             } else {
                 return false;
@@ -473,8 +686,7 @@ bool Bookstore::handleLogCommand(const std::vector<std::string>& tokens) {
 
             logSystem.logOperation(accountSystem.getCurrentUserID(), "log", "查看系统日志");
 
-            std::string report = logSystem.generateFullLogReport();
-            std::cout << report;
+            logSystem.streamFullLogReport(commandOutput());
             return true;
         }
     } catch (const std::exception& e) {
@@ -487,6 +699,34 @@ bool Bookstore::handleLogCommand(const std::vector<std::string>& tokens) {
 
     return false;
 }
+
+bool Bookstore::handleTransactionCommand(const Tokens& tokens) {
+    if (tokens.size() != 1) return false;
+
+    const std::string_view command = tokens[0];
+    LoginStack* session = accountSystem.currentStack();
+    std::lock_guard<std::mutex> guard(transactionMutex);
+
+    if (command == "begin") {
+        if (transactionOwner != nullptr || transactionsStopped) return false;
+        transactionOwner = session;
+        return true;
+    }
+
+    // commit/rollback 只能结束本会话的事务
+    if (transactionOwner != session) return false;
+
+    if (command == "commit") {
+        TransactionManager::commitAll();
+        bookSystem.invalidateQueryCache();
+        transactionRenames.clear();
+        transactionOwner = nullptr;
+        transactionEnded.notify_all();
+    } else {
+        rollbackTransaction();
+    }
+    return true;
+}
 bool Bookstore::isValidTotalCostStr(const std::string& costStr) {
     if (costStr.empty() || costStr.length() > 13) return false;
 
@@ -6,25 +6,33 @@
 
 LogSystem::LogSystem() : logFileName("system_log.txt"), accountSystem(nullptr) { };
 
-void LogSystem::logOperation(const std::string& userID, const std::string& command,
-                            const std::string& details) {
-    OperationLog log(userID, command, details);
-    operationLogs.push_back(log);
+void LogSystem::logOperation(const std::string& userID, std::string_view command,
+                            std::string_view details) {
+    OperationLog log(userID, std::string(command), std::string(details));
+    // 读帐户文件不必占着日志锁
+    Account account;
+    if (accountSystem) account = accountSystem->getAccountByID(userID);
+
+    std::lock_guard<std::recursive_mutex> lock(logMutex);
+    if (!logFile.is_open()) logFile.open(logFileName, std::ios::app);
+    if (logFile.is_open()) {
+        log.writeTo(logFile);
+        logFile << std::endl;
+    }
+    openLogs.push_back(std::move(log));
+    if (openLogs.size() >= LOG_SEGMENT) {
+        sealedLogs.push_back(std::make_shared<const LogSegment>(std::move(openLogs)));
+        openLogs = LogSegment();
+        openLogs.reserve(LOG_SEGMENT);
+    }
 
     if (accountSystem) {
-        Account account = accountSystem->getAccountByID(userID);
         if (account.getUserID() == userID) {
             updateEmployeeRecord(userID, account.getUsername(), account.getPrivilege());
         } else {
             updateEmployeeRecord(userID, userID, 1);  // 默认顾客权限
         }
     }
-
-    std::ofstream logFile(logFileName, std::ios::app);
-    if (logFile.is_open()) {
-        logFile << log.toString() << std::endl;
-        logFile.close();
-    }
 }
 
 void LogSystem::updateEmployeeRecord(const std::string& userID, 
@@ -64,21 +72,35 @@ void LogSystem::updateEmployeeRecord(const std::string& userID,
     employeeRecords.push_back(record);
 }
 
+LogSystem::LogSnapshot LogSystem::snapshotLogs() const {
+    std::lock_guard<std::recursive_mutex> lock(logMutex);
+    LogSnapshot snapshot = sealedLogs;
+    if (!openLogs.empty()) snapshot.push_back(std::make_shared<const LogSegment>(openLogs));
+    return snapshot;
+}
+
 std::vector<OperationLog> LogSystem::getAllLogs() const {
-    return operationLogs;
+    std::vector<OperationLog> logs;
+    for (const auto& segment : snapshotLogs()) {
+        logs.insert(logs.end(), segment->begin(), segment->end());
+    }
+    return logs;
 }
 
 std::vector<OperationLog> LogSystem::getUserLogs(const std::string& userID) const {
     std::vector<OperationLog> userLogs;
-    for (const auto& log : operationLogs) {
-        if (log.userID == userID) {
-            userLogs.push_back(log);
+    for (const auto& segment : snapshotLogs()) {
+        for (const auto& log : *segment) {
+            if (log.userID == userID) {
+                userLogs.push_back(log);
+            }
         }
     }
     return userLogs;
 }
 
 std::vector<EmployeeRecord> LogSystem::getEmployeeRecords() const {
+    std::lock_guard<std::recursive_mutex> lock(logMutex);
     return employeeRecords;
 }
 
@@ -90,40 +112,44 @@ void LogSystem::collectEmployeeRecordsFromLogs() {
 
     std::map<std::string, EmployeeRecord> employeeMap;
 
-    // 从操作日志中统计
-    for (const auto& log : operationLogs) {
-        std::string userID = log.userID;
-
-        if (userID.empty()) continue;
-
-        auto it = employeeMap.find(userID);
-        if (it != employeeMap.end()) {
-            it->second.operationCount++;
-            it->second.lastActive = log.timestamp;
-        } else {
-            EmployeeRecord record;
-            record.userID = userID;
-
-            try {
-                Account account = accountSystem->getAccountByID(userID);
-                if (account.getUserID() == userID) {
-                    record.username = account.getUsername();
-                    record.privilege = account.getPrivilege();
-                } else {
+    // 从操作日志中统计，统计期间不占日志锁
+    const LogSnapshot snapshot = snapshotLogs();
+    for (const auto& segment : snapshot) {
+        for (const auto& log : *segment) {
+            std::string userID = log.userID;
+
+            if (userID.empty()) continue;
+
+            auto it = employeeMap.find(userID);
+            if (it != employeeMap.end()) {
+                it->second.operationCount++;
+                it->second.lastActive = log.timestamp;
+            } else {
+                EmployeeRecord record;
+                record.userID = userID;
+
+                try {
+                    Account account = accountSystem->getAccountByID(userID);
+                    if (account.getUserID() == userID) {
+                        record.username = account.getUsername();
+                        record.privilege = account.getPrivilege();
+                    } else {
+                        record.username = userID;
+                        record.privilege = 1;
+                    }
+                } catch (...) {
                     record.username = userID;
                     record.privilege = 1;
                 }
-            } catch (...) {
-                record.username = userID;
-                record.privilege = 1;
-            }
 
-            record.operationCount = 1;
-            record.lastActive = log.timestamp;
-            employeeMap[userID] = record;
+                record.operationCount = 1;
+                record.lastActive = log.timestamp;
+                employeeMap[userID] = record;
+            }
         }
     }
 
+    std::lock_guard<std::recursive_mutex> lock(logMutex);
     employeeRecords.clear();
     for (const auto& [userID, record] : employeeMap) {
         employeeRecords.push_back(record);
@@ -141,6 +167,8 @@ void LogSystem::updateEmployeeRecordsFromAccounts(const std::vector<Account>& ac
         };
     }
 
+    std::lock_guard<std::recursive_mutex> lock(logMutex);
+
     for (auto& record : employeeRecords) {
         auto it = accountInfo.find(record.userID);
         if (it != accountInfo.end()) {
@@ -150,51 +178,52 @@ void LogSystem::updateEmployeeRecordsFromAccounts(const std::vector<Account>& ac
     }
 }
 
-std::string LogSystem::generateFinanceReport(const std::vector<std::pair<double, double>>& financeData) const {
-    std::ostringstream oss;
-    
-    oss << "=========================================================\n";
-    oss << "                  财务报表\n";
-    oss << "=========================================================\n\n";
-    
-    if (financeData.empty()) {
-        oss << "暂无财务数据\n";
-        return oss.str();
-    }
-    
+void LogSystem::streamFinanceReport(std::ostream& os, const FinanceSystem& finance) const {
+    ChunkedStreamBuf chunkBuf(os);
+    std::ostream out(&chunkBuf);
+
+    out << "=========================================================\n";
+    out << "                  财务报表\n";
+    out << "=========================================================\n\n";
+
     double totalIncome = 0.0;
     double totalExpense = 0.0;
     int transactionCount = 1;
-    
-    oss << "序号 |     收入     |     支出     |     净收益     |  交易时间\n";
-    oss << "-----+--------------+--------------+---------------+-------------------\n";
-    
-    for (const auto& record : financeData) {
-        double income = record.first;
-        double expense = record.second;
+
+    // 有没有数据以实际读到的记录为准，表头等到第一条记录再输出
+    finance.forEachRecord([&](const FinanceRecord& record) {
+        if (transactionCount == 1) {
+            out << "序号 |     收入     |     支出     |     净收益     |  交易时间\n";
+            out << "-----+--------------+--------------+---------------+-------------------\n";
+        }
+        double income = record.income;
+        double expense = record.expense;
         double netProfit = income - expense;
-        
+
         totalIncome += income;
         totalExpense += expense;
-        
-        oss << std::setw(4) << std::right << transactionCount++ << " | ";
-        oss << std::setw(12) << std::right << std::fixed << std::setprecision(2) << income << " | ";
-        oss << std::setw(12) << std::right << expense << " | ";
-        oss << std::setw(13) << std::right << netProfit << " | ";
-        oss << "第" << transactionCount-1 << "笔交易\n";
+
+        out << std::setw(4) << std::right << transactionCount++ << " | ";
+        out << std::setw(12) << std::right << std::fixed << std::setprecision(2) << income << " | ";
+        out << std::setw(12) << std::right << expense << " | ";
+        out << std::setw(13) << std::right << netProfit << " | ";
+        out << "第" << transactionCount-1 << "笔交易\n";
+    });
+
+    if (transactionCount == 1) {
+        out << "暂无财务数据\n";
+        return;
     }
-    
-    oss << "\n=========================================================\n";
-    oss << "财务汇总：\n";
-    oss << "总交易笔数: " << financeData.size() << "\n";
-    oss << "总收入: ¥" << std::fixed << std::setprecision(2) << totalIncome << "\n";
-    oss << "总支出: ¥" << totalExpense << "\n";
-    oss << "总利润: ¥" << (totalIncome - totalExpense) << "\n";
-    oss << "利润率: " << std::setprecision(1) 
+
+    out << "\n=========================================================\n";
+    out << "财务汇总：\n";
+    out << "总交易笔数: " << transactionCount - 1 << "\n";
+    out << "总收入: ¥" << std::fixed << std::setprecision(2) << totalIncome << "\n";
+    out << "总支出: ¥" << totalExpense << "\n";
+    out << "总利润: ¥" << (totalIncome - totalExpense) << "\n";
+    out << "利润率: " << std::setprecision(1)
         << (totalIncome > 0 ? ((totalIncome - totalExpense) / totalIncome * 100) : 0) << "%\n";
-    oss << "=========================================================\n";
-    
-    return oss.str();
+    out << "=========================================================\n";
 }
 
 std::string LogSystem::generateEmployeeReport() {
@@ -206,13 +235,14 @@ std::string LogSystem::generateEmployeeReport() {
 
     collectEmployeeRecordsFromLogs();
 
-    if (employeeRecords.empty()) {
+    // 复制一份员工记录，锁外排序、格式化
+    std::vector<EmployeeRecord> sortedRecords = getEmployeeRecords();
+    if (sortedRecords.empty()) {
         oss << "暂无员工记录\n";
         oss << "=========================================================\n";
         return oss.str();
     }
 
-    std::vector<EmployeeRecord> sortedRecords = employeeRecords;
     std::sort(sortedRecords.begin(), sortedRecords.end(),
         [](const EmployeeRecord& a, const EmployeeRecord& b) {
             if (a.privilege != b.privilege) {
@@ -295,60 +325,59 @@ std::string LogSystem::generateEmployeeReport() {
     return oss.str();
 }
 
-std::string LogSystem::generateFullLogReport() const {
-    std::ostringstream oss;
-    
-    oss << "=========================================================\n";
-    oss << "                   系统完整日志\n";
-    oss << "=========================================================\n\n";
-    
-    if (operationLogs.empty()) {
-        oss << "暂无日志记录\n";
-        return oss.str();
-    }
+void LogSystem::streamFullLogReport(std::ostream& os) const {
+    // 锁内只取快照，输出给慢连接时其他会话照常记日志
+    const LogSnapshot snapshot = snapshotLogs();
+    ChunkedStreamBuf chunkBuf(os);
+    std::ostream out(&chunkBuf);
 
-    std::vector<OperationLog> sortedLogs = operationLogs;
-    std::reverse(sortedLogs.begin(), sortedLogs.end()); // 最新的在前
-    
-    int count = 1;
-    for (const auto& log : sortedLogs) {
-        oss << "记录 #" << count++ << "\n";
-        oss << "─────────────────────────────────────────────────────────\n";
-        oss << log.toString() << "\n\n";
+    out << "=========================================================\n";
+    out << "                   系统完整日志\n";
+    out << "=========================================================\n\n";
 
-        if (count % 5 == 0) {
-            oss << "═════════════════════════════════════════════════════════\n\n";
-        }
-    }
-    
-    oss << "=========================================================\n";
-    oss << "日志统计：\n";
-    oss << "总记录数: " << operationLogs.size() << "\n";
-    
-    if (!operationLogs.empty()) {
-        oss << "最早记录: " << operationLogs.front().timestamp << "\n";
-        oss << "最新记录: " << operationLogs.back().timestamp << "\n";
+    if (snapshot.empty()) {
+        out << "暂无日志记录\n";
+        return;
     }
 
+    // 最新的在前，直接反向遍历，不复制日志
     std::map<std::string, int> userOperationCount;
-    for (const auto& log : operationLogs) {
-        userOperationCount[log.userID]++;
+    int count = 1;
+    size_t total = 0;
+    for (auto segment = snapshot.rbegin(); segment != snapshot.rend(); ++segment) {
+        for (auto it = (*segment)->rbegin(); it != (*segment)->rend(); ++it) {
+            out << "记录 #" << count++ << "\n";
+            out << "─────────────────────────────────────────────────────────\n";
+            out << it->toString() << "\n\n";
+
+            if (count % 5 == 0) {
+                out << "═════════════════════════════════════════════════════════\n\n";
+            }
+            userOperationCount[it->userID]++;
+            total++;
+        }
     }
-    
+
+    out << "=========================================================\n";
+    out << "日志统计：\n";
+    out << "总记录数: " << total << "\n";
+    out << "最早记录: " << snapshot.front()->front().timestamp << "\n";
+    out << "最新记录: " << snapshot.back()->back().timestamp << "\n";
+
     if (!userOperationCount.empty()) {
-        oss << "\n用户操作统计：\n";
+        out << "\n用户操作统计：\n";
         for (const auto& [userID, count] : userOperationCount) {
-            oss << "  " << std::setw(15) << std::left << userID 
+            out << "  " << std::setw(15) << std::left << userID
                 << ": " << count << " 次操作\n";
         }
     }
-    
-    oss << "=========================================================\n";
-    
-    return oss.str();
+
+    out << "=========================================================\n";
 }
 
 void LogSystem::clearLogs() {
-    operationLogs.clear();
+    std::lock_guard<std::recursive_mutex> lock(logMutex);
+    sealedLogs.clear();
+    openLogs.clear();
     employeeRecords.clear();
 }
\ No newline at end of file
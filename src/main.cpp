@@ -1,13 +1,40 @@
 #include <iostream>
 #include <string>
 #include "../include/bookstore.h"
+#include "../include/server.h"
 
-int main() {
+int main(int argc, char* argv[]) {
     // std::ios::sync_with_stdio(false);
     // std::cin.tie(nullptr);
     // std::cout.tie(nullptr);
 
+    // ./code --resident ...：数据常驻内存，靠快照加预写日志落盘（见 resident_file.h）
+    // ./code --io-uring ...：批量块读写经 io_uring 提交（见 io_ring.h）
+    // 两者都须在打开数据文件之前设置
+    int arg = 1;
+    for (; arg < argc; arg++) {
+        const std::string option = argv[arg];
+        if (option == "--resident") {
+            memoryResident = true;
+        } else if (option == "--io-uring") {
+            asyncIo = true;
+        } else {
+            break;
+        }
+    }
+
     Bookstore bookstore;
+
+    // ./code --server <socket>：多终端共享一个进程；否则从标准输入读指令
+    if (arg < argc && std::string(argv[arg]) == "--server") {
+        if (argc != arg + 2) {
+            std::cerr << "用法: " << argv[0] << " [--resident] [--io-uring] --server <socket path>" << std::endl;
+            return 1;
+        }
+        BookstoreServer server(bookstore, argv[arg + 1]);
+        return server.run() ? 0 : 1;
+    }
+
     bookstore.run();
 
     return 0;
@@ -0,0 +1,473 @@
+#include "../include/server.h"
+#include "../include/output.h"
+#include <streambuf>
+#include <csignal>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+namespace {
+    volatile sig_atomic_t stopRequested = 0;
+
+    void onStopSignal(int) {
+        stopRequested = 1;
+    }
+
+    constexpr int MAX_EVENTS = 64;
+    constexpr size_t READ_CHUNK = 4096;
+    constexpr size_t OUTPUT_CHUNK = 16 << 10;     // 工作线程攒够这么多输出交给连接一次
+    constexpr size_t OUTPUT_LIMIT = 256 << 10;    // 连接的输出缓冲积压到这么多时工作线程等待
+}
+
+// 指令输出流：攒满一段就交给连接（见 deliver），不把整条指令的输出留在内存里
+class BookstoreServer::OutputStream : public std::streambuf {
+private:
+    BookstoreServer& server;
+    Connection& conn;
+    char buffer[OUTPUT_CHUNK];
+
+protected:
+    int_type overflow(int_type ch) override {
+        sync();
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    int sync() override {
+        if (pptr() > pbase()) {
+            server.deliver(conn, pbase(), pptr() - pbase());
+            setp(buffer, buffer + sizeof(buffer));
+        }
+        return 0;
+    }
+
+public:
+    OutputStream(BookstoreServer& s, Connection& c) : server(s), conn(c) {
+        setp(buffer, buffer + sizeof(buffer));
+    }
+};
+
+BookstoreServer::BookstoreServer(Bookstore& store, std::string path, unsigned workerCount)
+    : bookstore(store), socketPath(std::move(path)), listenFd(-1), epollFd(-1), wakeFd(-1),
+      workerCount(workerCount), stopping(false), idleWorkers(0), stalledWorkers(0) {
+    if (this->workerCount == 0) {
+        this->workerCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+}
+
+BookstoreServer::~BookstoreServer() {
+    shutdown();
+}
+
+bool BookstoreServer::setupListener() {
+    sockaddr_un addr{};
+    if (socketPath.empty() || socketPath.length() >= sizeof(addr.sun_path)) {
+        std::cerr << "套接字路径非法: " << socketPath << std::endl;
+        return false;
+    }
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        std::cerr << "创建套接字失败: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+    unlink(socketPath.c_str());
+
+    if (bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        listen(listenFd, SOMAXCONN) < 0) {
+        std::cerr << "监听 " << socketPath << " 失败: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd < 0 || wakeFd < 0) {
+        std::cerr << "创建 epoll/eventfd 失败: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = listenFd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev) < 0) return false;
+
+    ev.data.fd = wakeFd;
+    return epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev) == 0;
+}
+
+bool BookstoreServer::run() {
+    if (!setupListener()) {
+        shutdown();
+        return false;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, onStopSignal);
+    signal(SIGTERM, onStopSignal);
+
+    // 工作线程开始等事务时唤醒事件循环，看是否要加开线程
+    bookstore.setWaitHook([this] { postCompletion({-1, false, true}); });
+    startWorkers(workerCount);
+
+    epoll_event events[MAX_EVENTS];
+    while (!stopRequested) {
+        const int n = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "epoll_wait 失败: " << strerror(errno) << std::endl;
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            const int fd = events[i].data.fd;
+            if (fd == listenFd) {
+                acceptConnections();
+                continue;
+            }
+            if (fd == wakeFd) {
+                handleCompletions();
+                continue;
+            }
+
+            auto it = connections.find(fd);
+            if (it == connections.end()) continue;
+            Connection& conn = *it->second;
+
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                handleReadable(conn);
+            }
+            if (events[i].events & EPOLLOUT) {
+                handleWritable(conn);
+            }
+            finishEvent(conn);
+        }
+    }
+
+    shutdown();
+    return true;
+}
+
+void BookstoreServer::startWorkers(unsigned count) {
+    for (unsigned i = 0; i < count; i++) {
+        workers.emplace_back(&BookstoreServer::workerLoop, this);
+    }
+}
+
+// 所有工作线程都在忙、其中有的停在慢连接上或在等其他会话的事务，而还有指令排队时，加开一个线程
+void BookstoreServer::growIfStarved() {
+    bool starved;
+    {
+        std::lock_guard<std::mutex> lock(taskMutex);
+        starved = stalledWorkers + bookstore.transactionWaiterCount() > 0 && tasks.size() > idleWorkers;
+    }
+    if (starved) startWorkers(1);
+}
+
+void BookstoreServer::stopWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(taskMutex);
+        stopping = true;
+        tasks.clear();
+    }
+    taskReady.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+}
+
+void BookstoreServer::workerLoop() {
+    while (true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(taskMutex);
+            idleWorkers++;
+            taskReady.wait(lock, [this] { return stopping || !tasks.empty(); });
+            idleWorkers--;
+            if (stopping) return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+
+        // 连接断开时在这里关闭会话：回滚事务要等指令闩，不能让事件循环去等——
+        // 持闩的工作线程可能正等事件循环把它的输出写出去
+        if (task.detach) {
+            bookstore.closeSession(&task.conn->loginStack);
+            postCompletion({task.fd, true, false});
+            continue;
+        }
+
+        // 把本线程切换到该连接的会话，输出分段写进连接自己的缓冲
+        bool keepGoing;
+        {
+            OutputStream buffer(*this, *task.conn);
+            std::ostream output(&buffer);
+            OutputRedirect redirect(output);
+            bookstore.switchSession(&task.conn->loginStack);
+            keepGoing = bookstore.executeLine(task.line);
+            bookstore.switchSession(nullptr);
+            output.flush();
+        }
+        postCompletion({task.fd, true, keepGoing});
+    }
+}
+
+// 工作线程把一段输出追加到连接的输出缓冲；积压过多时等事件循环写出一部分
+void BookstoreServer::deliver(Connection& conn, const char* data, size_t length) {
+    {
+        std::unique_lock<std::mutex> lock(conn.outMutex);
+        auto writable = [&conn] { return conn.discardOutput || conn.outBuffer.size() < OUTPUT_LIMIT; };
+        if (!writable()) {
+            {
+                std::lock_guard<std::mutex> guard(taskMutex);
+                stalledWorkers++;
+            }
+            // 唤醒事件循环：写出已有的输出，并在需要时加开工作线程
+            lock.unlock();
+            postCompletion({conn.fd, false, true});
+            lock.lock();
+            conn.outDrained.wait(lock, writable);
+            std::lock_guard<std::mutex> guard(taskMutex);
+            stalledWorkers--;
+        }
+        if (conn.discardOutput) return;
+        conn.outBuffer.append(data, length);
+    }
+    postCompletion({conn.fd, false, true});
+}
+
+void BookstoreServer::postCompletion(const Completion& completion) {
+    {
+        std::lock_guard<std::mutex> lock(completionMutex);
+        completions.push_back(completion);
+    }
+    const uint64_t one = 1;
+    if (::write(wakeFd, &one, sizeof(one)) < 0) {
+        // eventfd 计数已满时事件循环必然会被唤醒，忽略即可
+    }
+}
+
+void BookstoreServer::acceptConnections() {
+    while (true) {
+        const int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            return;  // EAGAIN：已全部接受
+        }
+
+        auto conn = std::make_unique<Connection>(fd);
+        bookstore.openSession(&conn->loginStack);
+
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            bookstore.closeSession(&conn->loginStack);
+            close(fd);
+            continue;
+        }
+        conn->registered = true;
+        connections.emplace(fd, std::move(conn));
+    }
+}
+
+void BookstoreServer::handleReadable(Connection& conn) {
+    char buffer[READ_CHUNK];
+    while (!conn.closing) {
+        const ssize_t n = read(conn.fd, buffer, sizeof(buffer));
+        if (n > 0) {
+            conn.inBuffer.append(buffer, n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+
+        // 对端关闭：末尾不完整的一行也照常执行
+        if (!conn.inBuffer.empty()) conn.inBuffer.push_back('\n');
+        conn.closing = true;
+        break;
+    }
+
+    splitLines(conn);
+    dispatchNext(conn);
+}
+
+void BookstoreServer::splitLines(Connection& conn) {
+    size_t start = 0;
+    size_t end;
+    while ((end = conn.inBuffer.find('\n', start)) != std::string::npos) {
+        std::string line = conn.inBuffer.substr(start, end - start);
+        start = end + 1;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        conn.pending.push_back(std::move(line));
+    }
+    conn.inBuffer.erase(0, start);
+}
+
+void BookstoreServer::dispatchNext(Connection& conn) {
+    if (conn.busy || conn.pending.empty()) return;
+
+    conn.busy = true;
+    {
+        std::lock_guard<std::mutex> lock(taskMutex);
+        tasks.push_back({conn.fd, &conn, std::move(conn.pending.front()), false});
+    }
+    conn.pending.pop_front();
+    taskReady.notify_one();
+    growIfStarved();
+}
+
+void BookstoreServer::handleCompletions() {
+    uint64_t counter;
+    while (::read(wakeFd, &counter, sizeof(counter)) > 0) {}
+
+    std::vector<Completion> done;
+    {
+        std::lock_guard<std::mutex> lock(completionMutex);
+        done.swap(completions);
+    }
+    growIfStarved();
+
+    for (auto& completion : done) {
+        auto it = connections.find(completion.fd);
+        if (it == connections.end()) continue;
+        Connection& conn = *it->second;
+
+        if (!completion.finished) {
+            handleWritable(conn);
+            finishEvent(conn);
+            continue;
+        }
+        conn.busy = false;
+        if (conn.detaching) {
+            conn.sessionClosed = true;
+            closeConnection(conn.fd);
+            continue;
+        }
+        if (!completion.keepGoing) {
+            // quit/exit：丢弃其后的指令，写完输出即断开
+            conn.closing = true;
+            conn.pending.clear();
+        }
+        dispatchNext(conn);
+        handleWritable(conn);
+        finishEvent(conn);
+    }
+}
+
+void BookstoreServer::handleWritable(Connection& conn) {
+    std::lock_guard<std::mutex> lock(conn.outMutex);
+    size_t sent = 0;
+    while (sent < conn.outBuffer.size()) {
+        const ssize_t n = send(conn.fd, conn.outBuffer.data() + sent, conn.outBuffer.size() - sent,
+                               MSG_NOSIGNAL);
+        if (n > 0) {
+            sent += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+
+        // 对端已断开，丢弃剩余输出与指令；正在执行的指令此后的输出也直接丢弃
+        conn.outBuffer.clear();
+        conn.discardOutput = true;
+        conn.pending.clear();
+        conn.closing = true;
+        conn.outDrained.notify_all();
+        return;
+    }
+    if (sent > 0) {
+        conn.outBuffer.erase(0, sent);
+        conn.outDrained.notify_all();
+    }
+}
+
+bool BookstoreServer::hasOutput(Connection& conn) {
+    std::lock_guard<std::mutex> lock(conn.outMutex);
+    return !conn.outBuffer.empty();
+}
+
+void BookstoreServer::finishEvent(Connection& conn) {
+    // 正在执行的指令还引用着这个连接，等它完成后再关闭；会话交给工作线程关闭（见 workerLoop）
+    const bool output = hasOutput(conn);
+    if (conn.closing && !conn.busy && !conn.detaching && conn.pending.empty() && !output) {
+        conn.busy = true;
+        {
+            std::lock_guard<std::mutex> lock(taskMutex);
+            tasks.push_back({conn.fd, &conn, std::string(), true});
+        }
+        taskReady.notify_one();
+        conn.detaching = true;
+    }
+
+    epoll_event ev{};
+    ev.events = 0;
+    if (!conn.closing) ev.events |= EPOLLIN;
+    if (output) ev.events |= EPOLLOUT;
+    ev.data.fd = conn.fd;
+
+    // 不关心任何事件时移出 epoll，否则对端挂断会被水平触发反复报告
+    if (ev.events == 0) {
+        if (conn.registered) {
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, conn.fd, nullptr);
+            conn.registered = false;
+        }
+    } else {
+        epoll_ctl(epollFd, conn.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, conn.fd, &ev);
+        conn.registered = true;
+    }
+}
+
+void BookstoreServer::closeConnection(int fd) {
+    auto it = connections.find(fd);
+    if (it == connections.end()) return;
+
+    if (it->second->registered) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+    if (!it->second->sessionClosed) bookstore.closeSession(&it->second->loginStack);
+    close(fd);
+    connections.erase(it);
+}
+
+void BookstoreServer::shutdown() {
+    // 先停工作线程，保证没有指令还引用着连接。等着写输出的工作线程不再等；
+    // 未提交的事务回滚，等它的工作线程放行
+    for (auto& item : connections) {
+        Connection& conn = *item.second;
+        std::lock_guard<std::mutex> lock(conn.outMutex);
+        conn.discardOutput = true;
+        conn.outDrained.notify_all();
+    }
+    if (!workers.empty()) bookstore.stopTransactions();
+    stopWorkers();
+
+    while (!connections.empty()) {
+        closeConnection(connections.begin()->first);
+    }
+    if (wakeFd >= 0) {
+        close(wakeFd);
+        wakeFd = -1;
+    }
+    if (epollFd >= 0) {
+        close(epollFd);
+        epollFd = -1;
+    }
+    if (listenFd >= 0) {
+        close(listenFd);
+        listenFd = -1;
+        unlink(socketPath.c_str());
+    }
+}
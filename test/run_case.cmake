@@ -0,0 +1,21 @@
+# 由 CMakeLists.txt 中的 add_case 调用：在干净的 WORK 目录里运行 BIN，比较输出
+file(REMOVE_RECURSE ${WORK})
+file(MAKE_DIRECTORY ${WORK})
+if(EXISTS ${CASE}.data)
+    file(COPY ${CASE}.data/ DESTINATION ${WORK})
+endif()
+
+execute_process(COMMAND ${BIN}
+                WORKING_DIRECTORY ${WORK}
+                INPUT_FILE ${CASE}.in
+                OUTPUT_FILE ${WORK}/out.txt
+                RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${BIN} exited with ${result}")
+endif()
+
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${WORK}/out.txt ${CASE}.out
+                RESULT_VARIABLE diff)
+if(NOT diff EQUAL 0)
+    message(FATAL_ERROR "output differs from ${CASE}.out, see ${WORK}/out.txt")
+endif()